@@ -0,0 +1,89 @@
+#version 410
+
+#define BOUNDARY_EDGE 0.0f
+#define MOUNTAIN_EDGE 1.0f
+#define VALLEY_EDGE 2.0f
+#define FACET_EDGE 3.0f
+
+// One primitive per edge: the vertex opposite to the edge in the first face, the two endpoints of the edge and
+// the vertex opposite to it in the second face. For boundary edges both faces are the same.
+layout(lines_adjacency) in;
+layout(triangle_strip, max_vertices = 24) out;
+
+uniform mat4 mvpMatrix;
+uniform mat4 modelMatrix;
+// Per edge: x is the edge type, y and z are +1 if the edge runs along the winding of its first/second face and -1
+// if it runs against it. Needed to get the face normals the right way around.
+uniform samplerBuffer edgeData;
+
+in vec3 vertexPosition[];
+
+out vec3 fragPosition;
+out vec3 fragColor;
+out float edgeType;
+
+const float width = 2.5e-3;
+
+vec3 edgeColor(float type)
+{
+    if (abs(type - BOUNDARY_EDGE) < 1e-4) {
+        return vec3(0, 0, 0);
+    } else if (abs(type - MOUNTAIN_EDGE) < 1e-4) {
+        return vec3(1, 0, 0);
+    } else if (abs(type - VALLEY_EDGE) < 1e-4) {
+        return vec3(0, 0, 1);
+    } else if (abs(type - FACET_EDGE) < 1e-4) {
+        return vec3(1, 1, 0);
+    }
+    return vec3(0);
+}
+
+void emitVertex(vec3 position, vec3 color, float type)
+{
+    gl_Position = mvpMatrix * vec4(position, 1);
+    fragPosition = (modelMatrix * vec4(position, 1)).xyz;
+    fragColor = color;
+    edgeType = type;
+    EmitVertex();
+}
+
+// corners in order around the quad
+void emitQuad(vec3 a, vec3 b, vec3 c, vec3 d, vec3 color, float type)
+{
+    emitVertex(a, color, type);
+    emitVertex(b, color, type);
+    emitVertex(d, color, type);
+    emitVertex(c, color, type);
+    EndPrimitive();
+}
+
+void main()
+{
+    vec3 data = texelFetch(edgeData, gl_PrimitiveIDIn).xyz;
+    vec3 color = edgeColor(data.x);
+
+    vec3 x = vertexPosition[1];
+    vec3 y = vertexPosition[2];
+    vec3 dir1 = y - x;
+    vec3 n1 = data.y * normalize(cross(dir1, vertexPosition[0] - x));
+    vec3 n2 = data.z * normalize(cross(dir1, vertexPosition[3] - x));
+    vec3 meanN = n1 + n2;
+    vec3 dir2 = width * normalize(cross(dir1, meanN));
+    meanN = width * normalize(meanN); // add meanN to prevent Z fighting
+
+    vec3 p0 = x - dir2 + meanN;
+    vec3 p1 = y - dir2 + meanN;
+    vec3 p2 = y + dir2 + meanN;
+    vec3 p3 = x + dir2 + meanN;
+    vec3 p4 = x - dir2 - meanN;
+    vec3 p5 = y - dir2 - meanN;
+    vec3 p6 = y + dir2 - meanN;
+    vec3 p7 = x + dir2 - meanN;
+
+    emitQuad(p0, p1, p2, p3, color, data.x);
+    emitQuad(p4, p5, p6, p7, color, data.x);
+    emitQuad(p0, p1, p5, p4, color, data.x);
+    emitQuad(p3, p2, p6, p7, color, data.x);
+    emitQuad(p0, p3, p7, p4, color, data.x);
+    emitQuad(p1, p2, p6, p5, color, data.x);
+}
@@ -25,9 +25,11 @@ DISABLE_WARNINGS_POP()
 #include <vector>
 #include "camera.h"
 #include "origami.h"
+#include "origami_renderer.h"
 #include "glyph_drawer.h"
 #include <ShObjIdl_core.h>
 #include "settings.h"
+#include "static_solver.h"
 
 class Application {
 public:
@@ -59,6 +61,7 @@ public:
         //m_origami = Origami::loadFromFile("origami_examples/mapfold.fold
         //m_origami = Origami::loadFromFile("origami_examples/huffmanWaterbomb.fold");
         m_origami = Origami::loadFromFile(m_filename);
+        m_renderer.load(m_origami);
 
         try {
             ShaderBuilder defaultBuilder;
@@ -78,6 +81,7 @@ public:
 
             ShaderBuilder edgeBuilder;
             edgeBuilder.addStage(GL_VERTEX_SHADER, RESOURCE_ROOT "shaders/edge_vert.glsl");
+            edgeBuilder.addStage(GL_GEOMETRY_SHADER, RESOURCE_ROOT "shaders/edge_geom.glsl");
             edgeBuilder.addStage(GL_FRAGMENT_SHADER, RESOURCE_ROOT "shaders/edge_frag.glsl");
             m_edgeShader = edgeBuilder.build();
 
@@ -113,11 +117,13 @@ public:
                 m_camera.updateInput();
             }
 
-            if (m_settings.simulate) {
+            const bool settled = m_settings.stop_when_converged && m_origami.convergence.converged;
+            if (m_settings.simulate && !settled) {
                 for (int i = 0; i < m_settings.steps_per_frame; i++) {
                     m_origami.step();
-                    m_origami.updateVertexBuffers();
                 }
+                // only the last state of the frame is drawn, so upload once
+                m_renderer.update(m_origami);
             }
 
             // Clear the screen
@@ -131,13 +137,13 @@ public:
             // https://paroj.github.io/gltut/Illumination/Tut09%20Normal%20Transformation.html
             const glm::mat3 normalModelMatrix = glm::inverseTranspose(glm::mat3(m_modelMatrix));
 
-            m_origami.draw(m_faceShader, m_edgeShader, mvpMatrix, m_settings);
+            m_renderer.draw(m_origami, m_faceShader, m_edgeShader, mvpMatrix, m_settings);
             drawGlyphs(mvpMatrix);
 
             // Processes input and swaps the window buffer
             m_window.swapBuffers();
         }
-        m_origami.free();
+        m_renderer.free();
     }
 
     // In here you can handle key presses
@@ -216,28 +222,103 @@ public:
             if (GetOpenFileNameA(&ofn))
             {
                 m_filename = std::string(filename);
-                m_origami.free();
+                m_renderer.free();
                 m_origami = Origami::loadFromFile(m_filename);
+                m_renderer.load(m_origami);
             }
         }
         ImGui::SameLine();
         ImGui::Text(m_origami.name.c_str());
-        ImGui::SliderFloat("Fold Percent", &m_origami.target_angle_percent, 0.0f, 1.0f);
+        if (m_origami.fold_ramp) {
+            ImGui::SliderFloat("Fold Percent", &m_origami.fold_ramp_target, 0.0f, 1.0f);
+        } else {
+            ImGui::SliderFloat("Fold Percent", &m_origami.target_angle_percent, 0.0f, 1.0f);
+        }
+        if (ImGui::Checkbox("Fold Ramp", &m_origami.fold_ramp) && m_origami.fold_ramp) {
+            m_origami.fold_ramp_target = m_origami.target_angle_percent;
+        }
+        if (m_origami.fold_ramp) {
+            ImGui::InputFloat("Max Strain", &m_origami.ramp_max_strain, 0.0f, 0.0f, "%.3f");
+            ImGui::InputFloat("Max Face Angle Error", &m_origami.ramp_max_face_error, 0.0f, 0.0f, "%.3f");
+            ImGui::Text("At %.3f, rate %.1e per step, strain %.3f, face angle error %.3f", double(m_origami.target_angle_percent),
+                double(m_origami.fold_ramp_rate), double(m_origami.ramp_strain), double(m_origami.ramp_face_error));
+        }
         ImGui::Checkbox("Simulate", &m_settings.simulate);
         ImGui::SameLine();
         ImGui::SliderInt("Steps Per Frame", &m_settings.steps_per_frame, 1, 10, "%d");
+        ImGui::Checkbox("Stop When Converged", &m_settings.stop_when_converged);
+        ImGui::SameLine();
+        ImGui::Checkbox("Watchdog", &m_origami.watchdog);
+        if (m_origami.watchdog) {
+            ImGui::SameLine();
+            ImGui::Text("%d rollbacks, time step %.2e", m_origami.rollbacks, double(m_origami.deltaT));
+        }
+        const ConvergenceStats& stats = m_origami.convergence;
+        ImGui::Text("%s after %d steps: max velocity %.2e, max force %.2e, kinetic energy %.2e",
+            stats.diverged ? "Diverged" : stats.converged ? "Converged" : "Running", stats.steps, double(stats.max_velocity),
+            double(stats.max_force), stats.kinetic_energy);
+        ImGui::Checkbox("Constraint Stats", &m_origami.gather_constraint_stats);
+        if (m_origami.gather_constraint_stats) {
+            const ConstraintStats& constraintStats = m_origami.constraint_stats;
+            ImGui::Text("Energy %.3e (axial %.2e, crease %.2e, face %.2e)", constraintStats.energy(), constraintStats.axial_energy,
+                constraintStats.crease_energy, constraintStats.face_energy);
+            ImGui::Text("Max strain %.2e, max crease angle error %.2e, max face angle error %.2e", double(constraintStats.max_strain),
+                double(constraintStats.max_crease_error), double(constraintStats.max_face_error));
+        }
+        ImGui::SliderInt("Threads", &m_origami.num_threads, 1, std::max(1, int(std::thread::hardware_concurrency())));
+        ImGui::Combo("Solver", &m_origami.solver, "Explicit\0Implicit\0Dynamic Relaxation\0XPBD\0");
+        if (m_origami.solver == SOLVER_EXPLICIT) {
+            ImGui::Checkbox("Adaptive Time Step", &m_origami.adaptive_time_step);
+            if (m_origami.adaptive_time_step) {
+                ImGui::InputFloat("Error Tolerance", &m_origami.adaptive_tolerance, 0.0f, 0.0f, "%.1e");
+                ImGui::Text("Accepted steps: %d, rejected steps: %d, last time step: %.2f deltaT", m_origami.accepted_steps,
+                    m_origami.rejected_steps, double(m_origami.last_time_step / m_origami.deltaT));
+            } else {
+                ImGui::Checkbox("Multirate", &m_origami.multirate);
+                if (m_origami.multirate) {
+                    ImGui::SliderInt("Levels", &m_origami.multirate_levels, 1, 6);
+                } else {
+                    ImGui::Checkbox("Active Set", &m_origami.active_set);
+                    if (m_origami.active_set) {
+                        ImGui::InputFloat("Sleep Velocity", &m_origami.active_set_velocity, 0.0f, 0.0f, "%.1e");
+                        ImGui::InputFloat("Sleep Force", &m_origami.active_set_force, 0.0f, 0.0f, "%.1e");
+                        ImGui::SliderInt("Sleep Steps", &m_origami.active_set_steps, 1, 200);
+                        ImGui::Text("Awake vertices: %.1f%%", double(100.0f * m_origami.active_fraction));
+                    }
+                }
+            }
+            ImGui::Checkbox("Double Precision", &m_origami.double_precision);
+        } else if (m_origami.solver == SOLVER_IMPLICIT) {
+            ImGui::SliderFloat("Time Step Scale", &m_origami.implicit_time_step_scale, 1.0f, 200.0f, "%.0f");
+            ImGui::Text("CG iterations: %d", m_origami.last_cg_iterations);
+        } else if (m_origami.solver == SOLVER_RELAXATION) {
+            ImGui::SliderFloat("Mass Scale", &m_origami.relaxation_mass_scale, 1.0f, 10.0f);
+            ImGui::Text("Residual: %g", double(m_origami.last_residual));
+        } else if (m_origami.solver == SOLVER_XPBD) {
+            ImGui::SliderFloat("Time Step Scale", &m_origami.xpbd_time_step_scale, 1.0f, 200.0f, "%.0f");
+            ImGui::SliderInt("Substeps", &m_origami.xpbd_substeps, 1, 50);
+            ImGui::SliderInt("Iterations", &m_origami.xpbd_iterations, 1, 20);
+        }
 
         if (ImGui::Button("Take Steps")) {
             for (int i = 0; i < m_settings.numberOfStepsToTake; i++) {
                 m_origami.step();
             }
-            m_origami.updateVertexBuffers();
+            m_renderer.update(m_origami);
         }
         ImGui::SameLine();
         ImGui::SliderInt("# Steps", &m_settings.numberOfStepsToTake, 1, 50);
+        if (ImGui::Button("Solve Equilibrium")) {
+            m_staticResult = m_staticSolver.solveInStages(m_origami);
+            m_renderer.update(m_origami);
+        }
+        ImGui::SameLine();
+        ImGui::Text("%d Newton iterations, %s, residual %g", m_staticResult.iterations,
+            m_staticResult.converged ? "converged" : "did not converge", double(m_staticResult.residual));
         if (ImGui::Button("Reset Origami")) {
-            m_origami.free();
+            m_renderer.free();
             m_origami = Origami::loadFromFile(m_filename);
+            m_renderer.load(m_origami);
         }
         ImGui::SliderFloat("Selected Point Radius", &m_settings.selectedPointRadius, 0.0f, 0.5f);
         ImGui::Checkbox("Show Facet Creases", &m_settings.showFacetEdges);
@@ -268,6 +349,19 @@ public:
             if (m_origami.enable_damping_force) {
                 ImGui::SliderFloat("Damping Ratio", &m_origami.damping_ratio, 0.0f, 0.5f);
             }
+            if (ImGui::Checkbox("Spectral Time Step", &m_origami.spectral_time_step)) {
+                m_origami.calculateOptimalTimeStep();
+            }
+            if (m_origami.spectral_time_step) {
+                // the stiffnesses and the shape change the estimate as well, so it can be redone at any time
+                if (ImGui::SliderFloat("Time Step Safety", &m_origami.time_step_safety, 0.1f, SPECTRAL_TIME_STEP_MAX_SAFETY)) {
+                    m_origami.calculateOptimalTimeStep();
+                }
+                if (ImGui::Button("Recompute Time Step")) {
+                    m_origami.calculateOptimalTimeStep();
+                }
+            }
+            ImGui::Text("Time step: %g", double(m_origami.deltaT));
             ImGui::NewLine();
         }
 
@@ -313,6 +407,10 @@ public:
             ImGui::NewLine();
         }
 
+        // any change in the UI may move the equilibrium, so simulate again until it has settled once more
+        if (ImGui::IsAnyItemActive()) {
+            m_origami.resetConvergence();
+        }
         ImGui::End();
     }
 
@@ -410,6 +508,9 @@ private:
 
     std::string m_filename = "origami_examples/mapfold.fold";
     Origami m_origami;
+    OrigamiRenderer m_renderer;
+    StaticSolver m_staticSolver;
+    StaticSolveResult m_staticResult;
     GlyphDrawer m_glyphDrawer;
 
     Settings m_settings;
@@ -0,0 +1,61 @@
+#include "block_sparse_matrix.h"
+#include <algorithm>
+#include "csr_table.h"
+#include "origamiexception.h"
+
+void BlockSparseMatrix::buildPattern(size_t rows, const std::vector<unsigned int>& entryRows, const std::vector<unsigned int>& entryColumns)
+{
+	std::vector<unsigned int> allRows(entryRows);
+	std::vector<unsigned int> allColumns(entryColumns);
+	for (unsigned int i = 0; i < rows; i++) {
+		allRows.push_back(i);
+		allColumns.push_back(i);
+	}
+	CsrTable table;
+	table.build(rows, allRows, allColumns);
+
+	// sort every row and drop the duplicates
+	offsets.assign(rows + 1, 0);
+	columns.clear();
+	m_diagonal_slots.resize(rows);
+	for (size_t i = 0; i < rows; i++) {
+		std::vector<unsigned int> row(table.row(i).begin(), table.row(i).end());
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+		for (unsigned int column : row) {
+			if (column == i) {
+				m_diagonal_slots[i] = static_cast<unsigned int>(columns.size());
+			}
+			columns.push_back(column);
+		}
+		offsets[i + 1] = static_cast<unsigned int>(columns.size());
+	}
+	blocks.assign(columns.size(), glm::mat3(0.0f));
+}
+
+unsigned int BlockSparseMatrix::slot(unsigned int row, unsigned int column) const
+{
+	auto begin = columns.begin() + offsets[row];
+	auto end = columns.begin() + offsets[row + 1];
+	auto it = std::lower_bound(begin, end, column);
+	if (it == end || *it != column) {
+		throw OrigamiException("Block is not part of the sparsity pattern");
+	}
+	return static_cast<unsigned int>(it - columns.begin());
+}
+
+void BlockSparseMatrix::setZero()
+{
+	std::fill(blocks.begin(), blocks.end(), glm::mat3(0.0f));
+}
+
+void BlockSparseMatrix::multiply(std::span<const glm::vec3> x, std::span<glm::vec3> y, size_t begin, size_t end) const
+{
+	for (size_t i = begin; i < end; i++) {
+		glm::vec3 sum(0.0f);
+		for (unsigned int k = offsets[i]; k < offsets[i + 1]; k++) {
+			sum += blocks[k] * x[columns[k]];
+		}
+		y[i] = sum;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/mat3x3.hpp>
+#include <glm/vec3.hpp>
+#include <span>
+#include <vector>
+
+/// <summary>
+/// Sparse matrix made of 3x3 blocks, one block row and column per vertex. The pattern is stored like a CsrTable:
+/// the blocks of row i are blocks[offsets[i]] up to blocks[offsets[i + 1]], with their columns in columns.
+/// The pattern is built once; after that the values can be refilled through the slot indices without searching.
+/// </summary>
+class BlockSparseMatrix {
+public:
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> columns;
+	std::vector<glm::mat3> blocks;
+
+	/// <summary>
+	/// Sets the pattern to the given (row, column) pairs, duplicates are allowed. Every diagonal block is
+	/// always part of the pattern. Columns are sorted within a row. All blocks are set to zero.
+	/// </summary>
+	void buildPattern(size_t rows, const std::vector<unsigned int>& entryRows, const std::vector<unsigned int>& entryColumns);
+
+	size_t rows() const {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	/// <summary>
+	/// Index into blocks of the block at (row, column), which has to be part of the pattern.
+	/// </summary>
+	unsigned int slot(unsigned int row, unsigned int column) const;
+
+	unsigned int diagonalSlot(unsigned int row) const {
+		return m_diagonal_slots[row];
+	}
+
+	void setZero();
+
+	/// <summary>
+	/// y[i] = (A x)[i] for the rows in [begin, end). Rows are independent, so different ranges can be done
+	/// on different threads.
+	/// </summary>
+	void multiply(std::span<const glm::vec3> x, std::span<glm::vec3> y, size_t begin, size_t end) const;
+
+private:
+	std::vector<unsigned int> m_diagonal_slots;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <glm/vec3.hpp>
+#include <span>
+#include <vector>
+
+/// <summary>
+/// Scratch vectors of conjugateGradient, kept between solves so they do not have to be allocated every step.
+/// </summary>
+struct ConjugateGradientWorkspace {
+	std::vector<glm::vec3> r;
+	std::vector<glm::vec3> z;
+	std::vector<glm::vec3> p;
+	std::vector<glm::vec3> Ap;
+};
+
+struct ConjugateGradientResult {
+	int iterations = 0;
+	/// <summary>
+	/// |b - Ax| / |b| at the end of the solve.
+	/// </summary>
+	float relative_residual = 0.0f;
+};
+
+inline double dotProduct(std::span<const glm::vec3> a, std::span<const glm::vec3> b)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i++) {
+		sum += double(a[i].x) * double(b[i].x) + double(a[i].y) * double(b[i].y) + double(a[i].z) * double(b[i].z);
+	}
+	return sum;
+}
+
+/// <summary>
+/// Solves A x = b for a symmetric positive definite A with preconditioned conjugate gradients, starting from the
+/// given x. multiply(in, out) has to compute out = A in, precondition(in, out) out = M^-1 in. Stops once the
+/// residual is below tolerance * |b| or after maxIterations iterations.
+/// </summary>
+template<typename Multiply, typename Precondition>
+ConjugateGradientResult conjugateGradient(std::span<const glm::vec3> b, std::span<glm::vec3> x, Multiply&& multiply, Precondition&& precondition,
+	float tolerance, int maxIterations, ConjugateGradientWorkspace& workspace)
+{
+	const size_t n = b.size();
+	workspace.r.resize(n);
+	workspace.z.resize(n);
+	workspace.p.resize(n);
+	workspace.Ap.resize(n);
+	std::span<glm::vec3> r(workspace.r), z(workspace.z), p(workspace.p), Ap(workspace.Ap);
+
+	ConjugateGradientResult result;
+	const double bNorm = std::sqrt(dotProduct(b, b));
+	if (bNorm == 0.0) {
+		std::fill(x.begin(), x.end(), glm::vec3(0.0f));
+		return result;
+	}
+
+	multiply(std::span<const glm::vec3>(x), Ap);
+	for (size_t i = 0; i < n; i++) {
+		r[i] = b[i] - Ap[i];
+	}
+	precondition(std::span<const glm::vec3>(r), z);
+	std::copy(z.begin(), z.end(), p.begin());
+	double rz = dotProduct(r, z);
+	double rNorm = std::sqrt(dotProduct(r, r));
+
+	while (result.iterations < maxIterations && rNorm > double(tolerance) * bNorm) {
+		multiply(std::span<const glm::vec3>(p), Ap);
+		const double pAp = dotProduct(p, Ap);
+		if (pAp <= 0.0) {
+			// not positive definite along p, the best we can do is stop here
+			break;
+		}
+		const float alpha = float(rz / pAp);
+		for (size_t i = 0; i < n; i++) {
+			x[i] += alpha * p[i];
+			r[i] -= alpha * Ap[i];
+		}
+		result.iterations++;
+
+		rNorm = std::sqrt(dotProduct(r, r));
+		precondition(std::span<const glm::vec3>(r), z);
+		const double rzNew = dotProduct(r, z);
+		const float beta = float(rzNew / rz);
+		rz = rzNew;
+		for (size_t i = 0; i < n; i++) {
+			p[i] = z[i] + beta * p[i];
+		}
+	}
+	result.relative_residual = float(rNorm / bNorm);
+	return result;
+}
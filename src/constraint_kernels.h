@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#ifdef _MSC_VER
+#include <corecrt_math_defines.h>
+#endif
+#include <glm/glm.hpp>
+
+// The geometry of the axial, crease and face constraints, templated on the scalar type so the same code runs in
+// single precision for the regular solvers and in double precision for Origami::double_precision. The float
+// versions do exactly the operations the solvers always did, so their results have not changed.
+
+template<typename T>
+using Vec3 = glm::vec<3, T, glm::defaultp>;
+
+/// <summary>
+/// The three angles of the triangle (x, y, z), at x, y and z.
+/// </summary>
+template<typename T>
+Vec3<T> triangleAngles(const Vec3<T>& x, const Vec3<T>& y, const Vec3<T>& z)
+{
+	Vec3<T> vYX = glm::normalize(y - x);
+	Vec3<T> vZX = glm::normalize(z - x);
+	Vec3<T> vZY = glm::normalize(z - y);
+	return Vec3<T>(
+		std::acos(std::clamp(glm::dot(vYX, vZX), T(-1), T(1))),
+		std::acos(std::clamp(glm::dot(-vYX, vZY), T(-1), T(1))),
+		std::acos(std::clamp(glm::dot(-vZX, -vZY), T(-1), T(1))) // yes I can cancel the -, but this is clearer
+	);
+}
+
+/// <summary>
+/// gradients[c][p] is the gradient of the angle at corner c with respect to corner p of the triangle (p1, p2, p3).
+/// </summary>
+template<typename T>
+void triangleAngleGradients(const Vec3<T>& p1, const Vec3<T>& p2, const Vec3<T>& p3, Vec3<T> gradients[3][3])
+{
+	const Vec3<T> d12 = p2 - p1;
+	const Vec3<T> d13 = p3 - p1;
+	const Vec3<T> d23 = p3 - p2;
+	const Vec3<T> n = glm::normalize(glm::cross(d12, d13));
+
+	// Moving a corner perpendicular to a side changes the angles at both ends of that side, so all nine
+	// derivatives are made out of the same three vectors.
+	const Vec3<T> g12 = glm::cross(n, d12) / glm::dot(d12, d12);
+	const Vec3<T> g13 = glm::cross(n, d13) / glm::dot(d13, d13);
+	const Vec3<T> g23 = glm::cross(n, d23) / glm::dot(d23, d23);
+
+	// angle at p1 (a123)
+	gradients[0][0] = g12 - g13;
+	gradients[0][1] = -g12;
+	gradients[0][2] = g13;
+
+	// angle at p2 (a231)
+	gradients[1][0] = -g12;
+	gradients[1][1] = g12 + g23;
+	gradients[1][2] = -g23;
+
+	// angle at p3 (a312)
+	gradients[2][0] = g13;
+	gradients[2][1] = -g23;
+	gradients[2][2] = g23 - g13;
+}
+
+/// <summary>
+/// Fold angle of the crease from x3 to x4 between the faces (x3, x4, x1) and (x3, x4, x2) minus thetaTarget,
+/// wrapped to [-pi, pi], and its gradient with respect to x1..x4. n1Sign and n2Sign are +1 or -1, depending on
+/// whether cross(x4 - x3, xk - x3) points the same way as the normal of the face.
+/// </summary>
+template<typename T>
+T creaseAngleError(const Vec3<T>& x1, const Vec3<T>& x2, const Vec3<T>& x3, const Vec3<T>& x4, T n1Sign, T n2Sign, T thetaTarget,
+	Vec3<T> gradient[4])
+{
+	// crease vector and the vectors from its start to the two opposite vertices
+	const Vec3<T> e = x4 - x3;
+	const Vec3<T> a1 = x1 - x3;
+	const Vec3<T> a2 = x2 - x3;
+
+	// |c| is twice the area of the face, c/|c| its normal up to the winding of the face
+	const Vec3<T> c1 = glm::cross(e, a1);
+	const Vec3<T> c2 = glm::cross(e, a2);
+	const T c1_length_sq = glm::dot(c1, c1);
+	const T c2_length_sq = glm::dot(c2, c2);
+	const T e_length_sq = glm::dot(e, e);
+	const T e_length = std::sqrt(e_length_sq);
+	const T h1 = std::sqrt(c1_length_sq) / e_length;
+	const T h2 = std::sqrt(c2_length_sq) / e_length;
+
+	// t is where the opposite vertex projects onto the crease, 0 at x3 and 1 at x4.
+	// These are the cot(a)/(cot(a)+cot(b)) ratios of the opposite corners of each face.
+	const T t1 = glm::dot(e, a1) / e_length_sq;
+	const T t2 = glm::dot(e, a2) / e_length_sq;
+
+	// n/h for both faces
+	gradient[0] = (n1Sign * e_length / c1_length_sq) * c1;
+	gradient[1] = (n2Sign * e_length / c2_length_sq) * c2;
+	gradient[2] = -(T(1) - t1) * gradient[0] - (T(1) - t2) * gradient[1];
+	gradient[3] = -t1 * gradient[0] - t2 * gradient[1];
+
+	// perpendiculars from the crease to the opposite vertices, their lengths are h1 and h2
+	const Vec3<T> p1proj = a1 - t1 * e;
+	const Vec3<T> p2proj = a2 - t2 * e;
+
+	T theta = std::acos(std::clamp(glm::dot(-p1proj, p2proj) / (h1 * h2), T(-1), T(1)));
+	// flip orientation based on normals if needed
+	if (n1Sign * glm::dot(c1, p1proj + p2proj) < 0) {
+		theta *= T(-1);
+	}
+
+	while (thetaTarget - theta > T(M_PI)) {
+		theta += T(2 * M_PI);
+	}
+	while (theta - thetaTarget > T(M_PI)) {
+		theta -= T(2 * M_PI);
+	}
+	return theta - thetaTarget;
+}
+
+/// <summary>
+/// Axial force of an edge with stiffness k on its first vertex p1; the force on p2 is the negation. Also returns
+/// the stretch l - nominalLength.
+/// </summary>
+template<typename T>
+Vec3<T> axialForce(const Vec3<T>& p1, const Vec3<T>& p2, T k, T nominalLength, T& stretch)
+{
+	T l = glm::length(p1 - p2);
+	Vec3<T> dldp1 = glm::normalize(p1 - p2);
+	stretch = l - nominalLength;
+	return -k * stretch * dldp1;
+}
+
+/// <summary>
+/// Damping force with coefficient c between two vertices moving at v1 and v2, on the first one.
+/// </summary>
+template<typename T>
+Vec3<T> dampingForce(const Vec3<T>& v1, const Vec3<T>& v2, T c)
+{
+	return c * (v2 - v1);
+}
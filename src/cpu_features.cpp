@@ -0,0 +1,36 @@
+#include "cpu_features.h"
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static bool detectAvx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// the OS has to save the ymm registers on a context switch (OSXSAVE, then XCR0 bits 1 and 2)
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	// also checks that the OS saves the ymm registers
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+bool cpuSupportsAvx2()
+{
+	static const bool supported = detectAvx2();
+	return supported;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+/// <summary>
+/// True if both the CPU and the operating system support AVX2, so the AVX2 kernels can be called.
+/// Checked once, the result is cached.
+/// </summary>
+bool cpuSupportsAvx2();
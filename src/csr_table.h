@@ -0,0 +1,40 @@
+#pragma once
+#include <span>
+#include <vector>
+
+/// <summary>
+/// Compressed sparse row table mapping every row (e.g. a vertex) to a list of indices (e.g. the edges
+/// that touch it). The entries of row i are indices[offsets[i]] up to indices[offsets[i + 1]].
+/// </summary>
+class CsrTable {
+public:
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> indices;
+
+	/// <summary>
+	/// Fills the table from a list of (row, index) pairs. Within a row the indices keep the order in which
+	/// they were given.
+	/// </summary>
+	void build(size_t rows, const std::vector<unsigned int>& entryRows, const std::vector<unsigned int>& entryIndices) {
+		offsets.assign(rows + 1, 0);
+		for (unsigned int row : entryRows) {
+			offsets[row + 1]++;
+		}
+		for (size_t i = 0; i < rows; i++) {
+			offsets[i + 1] += offsets[i];
+		}
+		indices.resize(entryIndices.size());
+		std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < entryRows.size(); i++) {
+			indices[next[entryRows[i]]++] = entryIndices[i];
+		}
+	}
+
+	size_t rows() const {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+
+	std::span<const unsigned int> row(size_t i) const {
+		return std::span<const unsigned int>(indices.data() + offsets[i], offsets[i + 1] - offsets[i]);
+	}
+};
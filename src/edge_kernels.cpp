@@ -0,0 +1,140 @@
+#include "edge_kernels.h"
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EDGE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only allow AVX2 intrinsics in functions that are compiled for it. FMA is left out on purpose:
+// contracting a multiply and an add would make the results differ from the scalar code.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+#ifdef EDGE_KERNELS_X86
+
+/// <summary>
+/// Loads component c of the vec3s at the given vertex indices.
+/// </summary>
+TARGET_AVX2 static inline __m256 gatherComponent(const glm::vec3* data, __m256i indices, int c)
+{
+	__m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(indices, _mm256_set1_epi32(3)), _mm256_set1_epi32(c));
+	return _mm256_i32gather_ps(reinterpret_cast<const float*>(data), offsets, 4);
+}
+
+TARGET_AVX2 static inline void storeBatch(glm::vec3* out, __m256 x, __m256 y, __m256 z)
+{
+	alignas(32) float xs[EDGE_BATCH], ys[EDGE_BATCH], zs[EDGE_BATCH];
+	_mm256_store_ps(xs, x);
+	_mm256_store_ps(ys, y);
+	_mm256_store_ps(zs, z);
+	for (size_t j = 0; j < EDGE_BATCH; j++) {
+		out[j] = glm::vec3(xs[j], ys[j], zs[j]);
+	}
+}
+
+/// <summary>
+/// Both terms share the loads of the edge indices, only the positions or velocities that are needed are gathered.
+/// </summary>
+template<bool Axial, bool Damping, bool Stats>
+TARGET_AVX2 static size_t edgeForcesAvx2Impl(const EdgeConstants<float>& edges, const glm::vec3* coords, const glm::vec3* velocity, size_t begin, size_t end, glm::vec3* out,
+	EdgeStats* stats)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	// the energies go into double lanes, a float sum over a whole range would lose too many digits
+	__m256d energyLow = _mm256_setzero_pd();
+	__m256d energyHigh = _mm256_setzero_pd();
+	__m256 maxStrain = _mm256_setzero_ps();
+	size_t i = begin;
+	for (; i + EDGE_BATCH <= end; i += EDGE_BATCH) {
+		__m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&edges.v1[i]));
+		__m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&edges.v2[i]));
+		__m256 fx = _mm256_setzero_ps();
+		__m256 fy = _mm256_setzero_ps();
+		__m256 fz = _mm256_setzero_ps();
+
+		if constexpr (Axial) {
+			__m256 dx = _mm256_sub_ps(gatherComponent(coords, v1, 0), gatherComponent(coords, v2, 0));
+			__m256 dy = _mm256_sub_ps(gatherComponent(coords, v1, 1), gatherComponent(coords, v2, 1));
+			__m256 dz = _mm256_sub_ps(gatherComponent(coords, v1, 2), gatherComponent(coords, v2, 2));
+
+			// l = length(d), dldp1 = normalize(d) = d * (1 / sqrt(dot(d, d)))
+			__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			__m256 l = _mm256_sqrt_ps(dot);
+			__m256 invLength = _mm256_div_ps(one, l);
+
+			// -k_axial * (l - nominal_length) * dldp1
+			__m256 nominal = _mm256_loadu_ps(&edges.nominal_length[i]);
+			__m256 stretch = _mm256_sub_ps(l, nominal);
+			__m256 k = _mm256_xor_ps(_mm256_loadu_ps(&edges.k_axial[i]), signBit);
+			__m256 s = _mm256_mul_ps(k, stretch);
+			fx = _mm256_mul_ps(s, _mm256_mul_ps(dx, invLength));
+			fy = _mm256_mul_ps(s, _mm256_mul_ps(dy, invLength));
+			fz = _mm256_mul_ps(s, _mm256_mul_ps(dz, invLength));
+
+			if constexpr (Stats) {
+				// s = -k (l - L), so -s (l - L) / 2 is the energy
+				__m256 energy = _mm256_mul_ps(half, _mm256_mul_ps(_mm256_xor_ps(s, signBit), stretch));
+				energyLow = _mm256_add_pd(energyLow, _mm256_cvtps_pd(_mm256_castps256_ps128(energy)));
+				energyHigh = _mm256_add_pd(energyHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(energy, 1)));
+				maxStrain = _mm256_max_ps(maxStrain, _mm256_div_ps(_mm256_andnot_ps(signBit, stretch), nominal));
+			}
+		}
+
+		if constexpr (Damping) {
+			// c * (v2 - v1)
+			__m256 c = _mm256_loadu_ps(&edges.damping[i]);
+			fx = _mm256_add_ps(fx, _mm256_mul_ps(c, _mm256_sub_ps(gatherComponent(velocity, v2, 0), gatherComponent(velocity, v1, 0))));
+			fy = _mm256_add_ps(fy, _mm256_mul_ps(c, _mm256_sub_ps(gatherComponent(velocity, v2, 1), gatherComponent(velocity, v1, 1))));
+			fz = _mm256_add_ps(fz, _mm256_mul_ps(c, _mm256_sub_ps(gatherComponent(velocity, v2, 2), gatherComponent(velocity, v1, 2))));
+		}
+
+		storeBatch(out + (i - begin), fx, fy, fz);
+	}
+
+	if constexpr (Stats) {
+		alignas(32) double energies[4];
+		_mm256_store_pd(energies, _mm256_add_pd(energyLow, energyHigh));
+		stats->energy += (energies[0] + energies[1]) + (energies[2] + energies[3]);
+		alignas(32) float strains[EDGE_BATCH];
+		_mm256_store_ps(strains, maxStrain);
+		for (float strain : strains) {
+			stats->max_strain = std::max(stats->max_strain, strain);
+		}
+	}
+	return i;
+}
+
+size_t edgeForcesAvx2(const EdgeConstants<float>& edges, const glm::vec3* coords, const glm::vec3* velocity, bool axial, bool damping, size_t begin, size_t end,
+	glm::vec3* out, EdgeStats* stats)
+{
+	if (axial && stats) {
+		if (damping) {
+			return edgeForcesAvx2Impl<true, true, true>(edges, coords, velocity, begin, end, out, stats);
+		}
+		return edgeForcesAvx2Impl<true, false, true>(edges, coords, velocity, begin, end, out, stats);
+	}
+	if (axial && damping) {
+		return edgeForcesAvx2Impl<true, true, false>(edges, coords, velocity, begin, end, out, stats);
+	} else if (axial) {
+		return edgeForcesAvx2Impl<true, false, false>(edges, coords, velocity, begin, end, out, stats);
+	} else if (damping) {
+		return edgeForcesAvx2Impl<false, true, false>(edges, coords, velocity, begin, end, out, stats);
+	}
+	return begin;
+}
+
+#else
+
+// no AVX2 on this architecture, everything is left to the scalar code
+size_t edgeForcesAvx2(const EdgeConstants<float>&, const glm::vec3*, const glm::vec3*, bool, bool, size_t begin, size_t, glm::vec3*, EdgeStats*)
+{
+	return begin;
+}
+
+#endif
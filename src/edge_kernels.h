@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <glm/vec3.hpp>
+#include <vector>
+
+/// <summary>
+/// Everything the axial and damping kernels need per edge, stored as one array per field so a batch of
+/// edges can be loaded with a single instruction per field. The constants depend on EA and damping_ratio and
+/// are recomputed by Origami::updateEdgeConstants when those change. T is the scalar type of the solver state
+/// they are used with.
+/// </summary>
+template<typename T>
+struct EdgeConstants {
+	std::vector<int> v1;
+	std::vector<int> v2;
+	std::vector<T> nominal_length;
+	/// <summary>
+	/// EA / nominal_length
+	/// </summary>
+	std::vector<T> k_axial;
+	/// <summary>
+	/// 2 * damping_ratio * sqrt(EA / nominal_length)
+	/// </summary>
+	std::vector<T> damping;
+
+	float EA = 0.0f;
+	float damping_ratio = 0.0f;
+
+	size_t size() const {
+		return v1.size();
+	}
+};
+
+/// <summary>
+/// Sum of the axial energies k_axial (l - L)^2 / 2 and the largest axial strain |l - L| / L of a range of edges.
+/// </summary>
+struct EdgeStats {
+	double energy = 0.0;
+	float max_strain = 0.0f;
+};
+
+/// <summary>
+/// Number of edges handled per iteration by the AVX2 kernels.
+/// </summary>
+constexpr size_t EDGE_BATCH = 8;
+
+/// <summary>
+/// AVX2 version of Origami::edgeForce. Writes the summed axial and/or damping force on v1 of edge begin + j to
+/// out[j], whole batches at a time, and returns the index of the first edge it did not handle; the caller does
+/// the remaining edges with the scalar version. The operations are done in the same order as the scalar code,
+/// so the results are bit-identical to it. With axial forces and stats, also adds the energies and strains of the
+/// edges it handled to stats; the energies are summed in a different order than the scalar code does.
+/// Only call this if cpuSupportsAvx2() returns true.
+/// </summary>
+size_t edgeForcesAvx2(const EdgeConstants<float>& edges, const glm::vec3* coords, const glm::vec3* velocity, bool axial, bool damping, size_t begin, size_t end,
+	glm::vec3* out, EdgeStats* stats = nullptr);
@@ -13,9 +13,12 @@ GlyphDrawer::GlyphDrawer(Settings& settings) : m_settings(settings)
 	m_vertex_size = 0;
 }
 
-void GlyphDrawer::loadGlyphs(Origami& origami, std::vector<glm::vec3> positions, std::vector<glm::vec3> directions, float scale)
+void GlyphDrawer::loadGlyphs(Origami& origami, std::span<const glm::vec3> vertexPositions, std::span<const glm::vec3> vertexDirections, float scale)
 {
-	assert(positions.size() == directions.size());
+	assert(vertexPositions.size() == vertexDirections.size());
+	// copied because the glyphs inside of the faces get appended
+	std::vector<glm::vec3> positions(vertexPositions.begin(), vertexPositions.end());
+	std::vector<glm::vec3> directions(vertexDirections.begin(), vertexDirections.end());
 	splitFaces(origami, positions, directions);
 	std::vector<glm::vec3> vertices;
 	std::vector<glm::uvec3> faces;
@@ -66,10 +69,11 @@ void GlyphDrawer::loadGlyphs(Origami& origami, std::vector<glm::vec3> positions,
 	m_vertex_size = 3 * faces.size();
 }
 
-void GlyphDrawer::loadGlyphsSetLength(Origami& origami, std::vector<glm::vec3> positions, std::vector<glm::vec3> directions, float length)
+void GlyphDrawer::loadGlyphsSetLength(Origami& origami, std::span<const glm::vec3> positions, std::span<const glm::vec3> vertexDirections, float length)
 {
+	std::vector<glm::vec3> directions(vertexDirections.size());
 	for (int i = 0; i < directions.size(); i++) {
-		directions[i] = glm::normalize(directions[i]) * length;
+		directions[i] = glm::normalize(vertexDirections[i]) * length;
 	}
 	loadGlyphs(origami, positions, directions, 1.0f);
 }
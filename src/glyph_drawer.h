@@ -1,4 +1,5 @@
 #pragma once
+#include <span>
 #include <vector>
 #include <glm/ext/vector_float3.hpp>
 #include <framework/shader.h>
@@ -10,8 +11,8 @@ class GlyphDrawer {
 public:
 	GlyphDrawer(Settings& settings);
 
-	void loadGlyphs(Origami& origami, std::vector<glm::vec3> positions, std::vector<glm::vec3> directions, float scale);
-	void loadGlyphsSetLength(Origami& origami, std::vector<glm::vec3> positions, std::vector<glm::vec3> directions, float length);
+	void loadGlyphs(Origami& origami, std::span<const glm::vec3> positions, std::span<const glm::vec3> directions, float scale);
+	void loadGlyphsSetLength(Origami& origami, std::span<const glm::vec3> positions, std::span<const glm::vec3> directions, float length);
 	void draw(const Shader &shader, glm::mat4 mvpMatrix, glm::vec3 color);
 	void free();
 
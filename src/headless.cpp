@@ -0,0 +1,364 @@
+// Runs the origami simulation without a window, so it can be used in batch jobs on machines without a GPU.
+//
+// Usage: OrigamiSimulatorHeadless <input.fold> <output.fold> [options]
+//   --percent <p>      fold percent to fold to, between 0 and 1 (default 1)
+//   --max-steps <n>    give up after this many steps (default 100000)
+//   --tolerance <t>    stop once no vertex moves faster than this (default 1e-4); for the relaxation solver
+//                      once the largest net force on a vertex is below this (default 1e-3)
+//   --force-tolerance <f>
+//                      also require the largest net force on a vertex to be below this (default: not checked)
+//   --settle-steps <n> number of steps in a row that have to meet the tolerances (default 1)
+//   --threads <n>      number of threads used for every step (default 1)
+//   --solver <name>    explicit, implicit, relaxation or xpbd (default explicit)
+//   --dt-scale <s>     time step of the implicit and XPBD solvers as a multiple of the explicit one (default 20)
+//   --substeps <n>     substeps per XPBD step (default 10)
+//   --adaptive         let the explicit solver adapt its time step
+//   --adaptive-tolerance <e>
+//                      largest position error per adaptive step (default 1e-4)
+//   --multirate        let the explicit solver step the vertices at softer edges less often
+//   --levels <n>       number of different time steps of --multirate (default 4)
+//   --spectral-dt      set the time step from the largest eigenvalues of the stiffness and damping matrices
+//   --dt-safety <s>    time step of --spectral-dt as a fraction of the critical one, at most 0.9 (default 0.85)
+//   --active-set       let the explicit solver skip the vertices that have settled
+//   --double           run the explicit solver in double precision
+//   --ramp             start flat and raise the fold percent as fast as the strain and face angle errors allow
+//   --ramp-strain <s>  largest axial strain |l - L| / L allowed by --ramp (default 0.1)
+//   --ramp-face-error <e>
+//                      largest face angle error in radians allowed by --ramp (default 0.2)
+//   --watchdog         go back to the state of some steps ago and halve the time step when the simulation blows up
+//   --stats            print the energies and largest residuals of the constraints at the end
+//   --static           solve for the rest shape directly instead of simulating; --tolerance is then the
+//                      largest allowed net force on a vertex (default 1e-3) and --max-steps the number of
+//                      Newton iterations per stage (default 200)
+//   --stages <n>       with --static, reach the fold percent in this many solves (default 5)
+//   --sweep <n>        write the equilibrium at every one of n equal increments of the fold percent, starting at
+//                      0; each one starts from the one before it. The files are named <output>_<i>.fold for
+//                      the i-th increment.
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "origami.h"
+#include "origamiexception.h"
+#include "static_solver.h"
+
+struct HeadlessOptions {
+    std::string input;
+    std::string output;
+    float target_angle_percent = 1.0f;
+    int max_steps = 100000;
+    float tolerance = 1e-4f;
+    bool tolerance_set = false;
+    float force_tolerance = 0.0f;
+    int settle_steps = 1;
+    bool max_steps_set = false;
+    int num_threads = 1;
+    int solver = SOLVER_EXPLICIT;
+    float implicit_time_step_scale = 20.0f;
+    int xpbd_substeps = 10;
+    bool adaptive = false;
+    float adaptive_tolerance = 1e-4f;
+    bool multirate = false;
+    int multirate_levels = 4;
+    bool spectral_time_step = false;
+    float time_step_safety = 0.85f;
+    bool active_set = false;
+    bool double_precision = false;
+    bool fold_ramp = false;
+    float ramp_max_strain = 0.1f;
+    float ramp_max_face_error = 0.2f;
+    bool watchdog = false;
+    bool constraint_stats = false;
+    bool static_solve = false;
+    int stages = 5;
+    int sweep = 0;
+};
+
+static void printUsage()
+{
+    std::cerr << "Usage: OrigamiSimulatorHeadless <input.fold> <output.fold> [--percent <p>] [--max-steps <n>] [--tolerance <t>] [--force-tolerance <f>] [--settle-steps <n>] [--threads <n>] [--solver explicit|implicit|relaxation|xpbd] [--dt-scale <s>] [--substeps <n>] [--adaptive] [--adaptive-tolerance <e>] [--multirate] [--levels <n>] [--spectral-dt] [--dt-safety <s>] [--active-set] [--double] [--ramp] [--ramp-strain <s>] [--ramp-face-error <e>] [--watchdog] [--stats] [--static] [--stages <n>] [--sweep <n>]" << std::endl;
+}
+
+static bool parseArguments(int argc, char** argv, HeadlessOptions& options)
+{
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--percent" && hasValue) {
+            options.target_angle_percent = std::stof(argv[++i]);
+        } else if (arg == "--max-steps" && hasValue) {
+            options.max_steps = std::stoi(argv[++i]);
+            options.max_steps_set = true;
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::stof(argv[++i]);
+            options.tolerance_set = true;
+        } else if (arg == "--force-tolerance" && hasValue) {
+            options.force_tolerance = std::stof(argv[++i]);
+        } else if (arg == "--settle-steps" && hasValue) {
+            options.settle_steps = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.num_threads = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--solver" && hasValue) {
+            std::string solver = argv[++i];
+            if (solver == "explicit") {
+                options.solver = SOLVER_EXPLICIT;
+            } else if (solver == "implicit") {
+                options.solver = SOLVER_IMPLICIT;
+            } else if (solver == "relaxation") {
+                options.solver = SOLVER_RELAXATION;
+            } else if (solver == "xpbd") {
+                options.solver = SOLVER_XPBD;
+            } else {
+                std::cerr << "Unknown solver " << solver << std::endl;
+                return false;
+            }
+        } else if (arg == "--dt-scale" && hasValue) {
+            options.implicit_time_step_scale = std::stof(argv[++i]);
+        } else if (arg == "--substeps" && hasValue) {
+            options.xpbd_substeps = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--adaptive") {
+            options.adaptive = true;
+        } else if (arg == "--adaptive-tolerance" && hasValue) {
+            options.adaptive_tolerance = std::stof(argv[++i]);
+        } else if (arg == "--multirate") {
+            options.multirate = true;
+        } else if (arg == "--levels" && hasValue) {
+            options.multirate_levels = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--spectral-dt") {
+            options.spectral_time_step = true;
+        } else if (arg == "--dt-safety" && hasValue) {
+            options.time_step_safety = std::stof(argv[++i]);
+        } else if (arg == "--active-set") {
+            options.active_set = true;
+        } else if (arg == "--double") {
+            options.double_precision = true;
+        } else if (arg == "--ramp") {
+            options.fold_ramp = true;
+        } else if (arg == "--ramp-strain" && hasValue) {
+            options.ramp_max_strain = std::stof(argv[++i]);
+        } else if (arg == "--ramp-face-error" && hasValue) {
+            options.ramp_max_face_error = std::stof(argv[++i]);
+        } else if (arg == "--watchdog") {
+            options.watchdog = true;
+        } else if (arg == "--stats") {
+            options.constraint_stats = true;
+        } else if (arg == "--static") {
+            options.static_solve = true;
+        } else if (arg == "--stages" && hasValue) {
+            options.stages = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--sweep" && hasValue) {
+            options.sweep = std::max(1, std::stoi(argv[++i]));
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown or incomplete option " << arg << std::endl;
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 2) {
+        return false;
+    }
+    options.input = positional[0];
+    options.output = positional[1];
+    return true;
+}
+
+/// <summary>
+/// --tolerance and --max-steps mean the residual and the number of Newton iterations for the static solver.
+/// </summary>
+static StaticSolver makeStaticSolver(const HeadlessOptions& options)
+{
+    StaticSolver solver;
+    if (options.tolerance_set) {
+        solver.tolerance = options.tolerance;
+    }
+    if (options.max_steps_set) {
+        solver.max_iterations = options.max_steps;
+    }
+    return solver;
+}
+
+/// <summary>
+/// Steps until the origami has converged, diverged or maxSteps steps were taken, and returns the number of steps.
+/// </summary>
+static int simulate(Origami& origami, int maxSteps)
+{
+    int steps = 0;
+    while (steps < maxSteps && !origami.convergence.converged && !origami.convergence.diverged) {
+        origami.step();
+        steps++;
+    }
+    return steps;
+}
+
+static void printSimulation(const Origami& origami, int steps)
+{
+    const ConvergenceStats& stats = origami.convergence;
+    std::cout << steps << " steps, " << (stats.converged ? "converged" : stats.diverged ? "diverged" : "did not converge") << ", max velocity "
+              << stats.max_velocity << ", max force " << stats.max_force << ", kinetic energy " << stats.kinetic_energy << std::endl;
+}
+
+/// <summary>
+/// output with _<index> added to its name, with as many digits as the largest index has.
+/// </summary>
+static std::filesystem::path sweepPath(const std::filesystem::path& output, int index, int count)
+{
+    std::ostringstream name;
+    name << output.stem().string() << '_' << std::setw(int(std::to_string(count).size())) << std::setfill('0') << index
+         << output.extension().string();
+    return output.parent_path() / name.str();
+}
+
+/// <summary>
+/// Goes to every increment of the fold percent in turn, starting from the state the previous one settled in,
+/// and writes every equilibrium. Returns whether all of them converged.
+/// </summary>
+static bool sweep(Origami& origami, const HeadlessOptions& options)
+{
+    StaticSolver solver = makeStaticSolver(options);
+    bool all = true;
+    int totalSteps = 0;
+    for (int i = 0; i <= options.sweep; i++) {
+        const float percent = options.target_angle_percent * float(i) / float(options.sweep);
+        if (origami.fold_ramp) {
+            // ramp from the previous increment to this one
+            origami.fold_ramp_target = percent;
+        } else {
+            origami.target_angle_percent = percent;
+        }
+        std::cout << origami.name << " at " << percent << ": ";
+        bool converged;
+        if (options.static_solve) {
+            StaticSolveResult result = solver.solve(origami);
+            converged = result.converged;
+            totalSteps += result.iterations;
+            std::cout << result.iterations << " Newton iterations, " << (converged ? "converged" : "did not converge") << ", residual "
+                      << result.residual << std::endl;
+        } else {
+            origami.resetConvergence();
+            const int steps = simulate(origami, options.max_steps);
+            converged = origami.convergence.converged;
+            totalSteps += steps;
+            printSimulation(origami, steps);
+            if (origami.convergence.diverged) {
+                return false;
+            }
+        }
+        origami.saveToFile(sweepPath(options.output, i, options.sweep));
+        all = all && converged;
+    }
+    std::cout << totalSteps << (options.static_solve ? " Newton iterations" : " steps") << " in total, " << origami.constraint_evaluations
+              << " constraint evaluations" << std::endl;
+    return all;
+}
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions options;
+    try {
+        if (!parseArguments(argc, argv, options)) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        Origami origami = Origami::loadFromFile(options.input);
+        origami.target_angle_percent = options.target_angle_percent;
+        origami.num_threads = options.num_threads;
+        origami.solver = options.solver;
+        origami.implicit_time_step_scale = options.implicit_time_step_scale;
+        origami.xpbd_time_step_scale = options.implicit_time_step_scale;
+        origami.xpbd_substeps = options.xpbd_substeps;
+        origami.adaptive_time_step = options.adaptive;
+        origami.adaptive_tolerance = options.adaptive_tolerance;
+        origami.multirate = options.multirate;
+        origami.multirate_levels = options.multirate_levels;
+        origami.active_set = options.active_set;
+        origami.double_precision = options.double_precision;
+        if (options.fold_ramp && !options.static_solve) {
+            origami.fold_ramp = true;
+            origami.fold_ramp_target = options.target_angle_percent;
+            origami.ramp_max_strain = options.ramp_max_strain;
+            origami.ramp_max_face_error = options.ramp_max_face_error;
+            origami.target_angle_percent = 0.0f;
+        }
+        origami.watchdog = options.watchdog;
+        origami.gather_constraint_stats = options.constraint_stats;
+        if (origami.double_precision && !origami.doublePrecisionActive() && !options.static_solve) {
+            std::cerr << "Warning: --double only applies to the explicit solver" << std::endl;
+        }
+        origami.convergence_velocity = options.tolerance;
+        origami.convergence_force = options.force_tolerance;
+        origami.convergence_steps = options.settle_steps;
+        if (options.tolerance_set) {
+            origami.relaxation_tolerance = options.tolerance;
+        }
+        if (options.spectral_time_step) {
+            origami.spectral_time_step = true;
+            origami.time_step_safety = options.time_step_safety;
+            origami.calculateOptimalTimeStep();
+        }
+
+        if (options.sweep > 0) {
+            return sweep(origami, options) ? EXIT_SUCCESS : 2;
+        }
+
+        if (options.static_solve) {
+            StaticSolver solver = makeStaticSolver(options);
+            StaticSolveResult result = solver.solveInStages(origami, options.stages);
+            origami.saveToFile(options.output);
+
+            std::cout << origami.name << ": " << result.iterations << " Newton iterations (" << result.cg_iterations << " CG iterations), "
+                      << (result.converged ? "converged" : "did not converge") << ", residual " << result.residual << std::endl;
+            return result.converged ? EXIT_SUCCESS : 2;
+        }
+
+        const int steps = simulate(origami, options.max_steps);
+        const bool converged = origami.convergence.converged;
+
+        origami.saveToFile(options.output);
+
+        std::cout << origami.name << ": ";
+        printSimulation(origami, steps);
+        if (origami.solver == SOLVER_EXPLICIT && origami.adaptive_time_step) {
+            std::cout << origami.accepted_steps << " accepted and " << origami.rejected_steps << " rejected steps, last time step "
+                      << origami.last_time_step / origami.deltaT << " deltaT" << std::endl;
+        }
+        if (origami.fold_ramp) {
+            std::cout << "fold ramp reached " << origami.target_angle_percent << ", last rate " << origami.fold_ramp_rate << " per step, strain "
+                      << origami.ramp_strain << ", face angle error " << origami.ramp_face_error << std::endl;
+        }
+        if (origami.watchdog) {
+            std::cout << origami.rollbacks << " rollbacks, time step " << origami.deltaT << std::endl;
+        }
+        if (origami.gather_constraint_stats) {
+            // the last step gathered the stats for the positions before it
+            const ConstraintStats& stats = origami.computeConstraintStats();
+            std::cout << "energy " << stats.energy() << " (axial " << stats.axial_energy << ", crease " << stats.crease_energy << ", face "
+                      << stats.face_energy << "), max strain " << stats.max_strain << ", max crease angle error " << stats.max_crease_error
+                      << ", max face angle error " << stats.max_face_error << std::endl;
+        }
+        if (origami.active_set) {
+            std::cout << origami.active_fraction * 100.0f << "% of the vertices awake at the end" << std::endl;
+        }
+        std::cout << origami.constraint_evaluations << " constraint evaluations, " << origami.constraint_evaluations / uint64_t(std::max(steps, 1))
+                  << " per step" << std::endl;
+        return converged ? EXIT_SUCCESS : 2;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    } catch (const char* e) {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -3,12 +3,18 @@
 #include <fstream>
 #include "../external_code/third_party/json/single_include/nlohmann/json.hpp"
 #include <iostream>
-#include <glm/gtc/type_ptr.hpp>
 #include "origamiexception.h"
 #include <cmath>
+#ifdef _MSC_VER
 #include <corecrt_math_defines.h>
+#endif
 #include <framework/ray.h>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
 #include "settings.h"
+#include "cpu_features.h"
+#include "constraint_kernels.h"
 
 using json = nlohmann::json;
 
@@ -31,7 +37,7 @@ Origami Origami::loadFromFile(std::filesystem::path filePath) {
 
 	// load vertices and initial velocities
 	for (json vert : data["vertices_coords"]) {		
-		origami.vertices.push_back(VertexData(glm::vec3(vert[0], vert[1], vert[2]), glm::vec3(0), glm::vec3(0)));
+		origami.vertices.push_back(glm::vec3(vert[0], vert[1], vert[2]));
 	}
 
 	origami.normalizeVertices();
@@ -71,44 +77,61 @@ Origami Origami::loadFromFile(std::filesystem::path filePath) {
 		origami.nominal_angles.push_back(origami.angles(face));
 	}
 
-	// precalculate nominal lengths and faces adjacent to each edge
+	// precalculate nominal lengths
 	for (int i = 0; i < origami.edges.size(); i++) {
-		// calculate nominal length
-		origami.nominal_length.push_back(glm::length(origami.vertices[origami.edges[i].x].coords - origami.vertices[origami.edges[i].y].coords));
-
-		// precompute adjacent faces
-		unsigned int f1, f2;
-		f1 = f2 = origami.faces.size();
-		for (int j = 0; j < origami.faces.size(); j++) {
-			// check that both vertices of then edge are vertices of then face
-			if (
-				(origami.edges[i].x == origami.faces[j].x || origami.edges[i].x == origami.faces[j].y || origami.edges[i].x == origami.faces[j].z) &&
-				(origami.edges[i].y == origami.faces[j].x || origami.edges[i].y == origami.faces[j].y || origami.edges[i].y == origami.faces[j].z)
-				) {
-				if (f1 == origami.faces.size()) {
-					f1 = j;
-				}
-				else if (f2 == origami.faces.size()) {
-					f2 = j;
-				}
-				else {
-					std::string msg = "Edge " + std::to_string(i) + " is adjacent to more than 2 faces.";
-					throw OrigamiException(msg.c_str());
-				}
-			}
-		}
-		if (f2 == origami.faces.size()) {
-			f2 = f1;
-		}
-		origami.edge_to_faces.push_back(glm::uvec2(f1, f2));
+		origami.nominal_length.push_back(glm::length(origami.vertices.coords[origami.edges[i].x] - origami.vertices.coords[origami.edges[i].y]));
 	}
 
+	origami.prepareDoubleRestShape();
+
+	origami.buildAdjacency();
+
+	origami.prepareCreases();
 	origami.calculateOptimalTimeStep();
-	origami.prepareGpuMesh();
 
 	return origami;
 }
 
+void Origami::saveToFile(std::filesystem::path filePath)
+{
+	json data;
+	data["file_spec"] = 1.1;
+	data["frame_title"] = name;
+
+	json vertices_coords = json::array();
+	for (size_t i = 0; i < vertices.size(); i++) {
+		vertices_coords.push_back({ vertices.coords[i].x, vertices.coords[i].y, vertices.coords[i].z });
+	}
+	data["vertices_coords"] = vertices_coords;
+
+	json edges_vertices = json::array();
+	json edges_assignment = json::array();
+	for (glm::uvec3 edge : edges) {
+		edges_vertices.push_back({ edge.x, edge.y });
+		switch (edge.z) {
+		case MOUNTAIN_EDGE: edges_assignment.push_back("M"); break;
+		case VALLEY_EDGE: edges_assignment.push_back("V"); break;
+		case FACET_EDGE: edges_assignment.push_back("F"); break;
+		default: edges_assignment.push_back("B"); break;
+		}
+	}
+	data["edges_vertices"] = edges_vertices;
+	data["edges_assignment"] = edges_assignment;
+
+	json faces_vertices = json::array();
+	for (glm::uvec3 face : faces) {
+		faces_vertices.push_back({ face.x, face.y, face.z });
+	}
+	data["faces_vertices"] = faces_vertices;
+
+	std::ofstream f(filePath);
+	if (!f) {
+		std::string msg = "Could not open " + filePath.string() + " for writing.";
+		throw OrigamiException(msg.c_str());
+	}
+	f << data.dump(1, '\t') << std::endl;
+}
+
 float areaOfTriangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3) {
 	return glm::length(glm::cross(p2 - p1, p3 - p1)) / 2.0f;
 }
@@ -123,7 +146,7 @@ void Origami::triangulate(std::vector<unsigned int> verts) {
 	}
 	glm::vec3 outside_point(0);
 	for (unsigned int v : verts) {
-		outside_point = glm::max(outside_point, this->vertices[v].coords);
+		outside_point = glm::max(outside_point, this->vertices.coords[v]);
 	}
 	outside_point += 1.0f;
 	// try to find an ear of the polygon
@@ -136,13 +159,13 @@ void Origami::triangulate(std::vector<unsigned int> verts) {
 		// 2) the line must be inside of the polygon <=> the line's midpoint must be inside
 		bool is_ear = true;
 		// 1)
-		float area = areaOfTriangle(this->vertices[v0].coords, this->vertices[v1].coords, this->vertices[v2].coords);
+		float area = areaOfTriangle(this->vertices.coords[v0], this->vertices.coords[v1], this->vertices.coords[v2]);
 		for (int j = 0; j < verts.size() - 3; j++) {
 			unsigned int vx = verts[(i + 3 + j) % verts.size()];
 			float area_around_point = 
-				areaOfTriangle(this->vertices[vx].coords, this->vertices[v1].coords, this->vertices[v2].coords) + 
-				areaOfTriangle(this->vertices[v0].coords, this->vertices[vx].coords, this->vertices[v2].coords) + 
-				areaOfTriangle(this->vertices[v0].coords, this->vertices[v1].coords, this->vertices[vx].coords);
+				areaOfTriangle(this->vertices.coords[vx], this->vertices.coords[v1], this->vertices.coords[v2]) + 
+				areaOfTriangle(this->vertices.coords[v0], this->vertices.coords[vx], this->vertices.coords[v2]) + 
+				areaOfTriangle(this->vertices.coords[v0], this->vertices.coords[v1], this->vertices.coords[vx]);
 
 			if (std::abs(area - area_around_point) <= 1.0e-4) {
 				is_ear = false;
@@ -167,477 +190,2078 @@ void Origami::triangulate(std::vector<unsigned int> verts) {
 	throw "Triangulation did not find an ear!";
 }
 
-void Origami::draw(const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, Settings& settings) {
-
-	// draw faces
-	face_shader.bind();
-	glUniformMatrix4fv(face_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-	glUniform1i(face_shader.getUniformLocation("renderMode"), settings.renderMode);
-	glUniform1f(face_shader.getUniformLocation("magnitudeCutoff"), settings.magnitudeCutoff);
-
-	glm::vec3 selectedPoint = getSelectedPoint(settings);
-	glUniform1i(face_shader.getUniformLocation("useSelectedPoint"), settings.useSelectedPoint ? 1 : 0);
-	glUniform3f(face_shader.getUniformLocation("selectedPoint"), selectedPoint.x, selectedPoint.y, selectedPoint.z);
-	glUniform1f(face_shader.getUniformLocation("selectedPointRadius"), settings.selectedPointRadius);
-
-	glBindVertexArray(m_vao_faces);
-	glDrawElements(GL_TRIANGLES, 3*this->faces.size(), GL_UNSIGNED_INT, nullptr);
-
-	//glDisable(GL_DEPTH_TEST);
-	//glDepthFunc(GL_LEQUAL);
-
-	//draw edges
-	edge_shader.bind();
-	glUniformMatrix4fv(edge_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-	glUniform1i(edge_shader.getUniformLocation("showFacetEdges"), settings.showFacetEdges ? 1 : 0);
-	glBindVertexArray(m_vao_edges);
-	glDrawElements(GL_TRIANGLES, 36*this->edges.size(), GL_UNSIGNED_INT, nullptr);
-
-	//glDepthFunc(GL_LESS);
-	//glEnable(GL_DEPTH_TEST);
-}
-//void Origami::draw(const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, int renderMode, float magnitudeCutoff) {
-//
-//	// draw faces
-//	face_shader.bind();
-//	glUniformMatrix4fv(face_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-//	glUniform1i(face_shader.getUniformLocation("renderMode"), renderMode);
-//	glUniform1f(face_shader.getUniformLocation("magnitudeCutoff"), magnitudeCutoff);
-//	glBindVertexArray(m_vao_faces);
-//	glDrawElements(GL_TRIANGLES, 3*this->faces.size(), GL_UNSIGNED_INT, nullptr);
-//
-//	//draw edges
-//	edge_shader.bind();
-//	glUniformMatrix4fv(edge_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
-//	glBindVertexArray(m_vao_edges);
-//	glDrawElements(GL_LINES, 2*this->edges.size(), GL_UNSIGNED_INT, nullptr);
-//}
-
-void Origami::updateVertexBuffers()
-{
-	glBindVertexArray(m_vao_faces);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_faces);
-
-	auto formattedVertices = formatVertices();
-	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(formattedVertices.size() * sizeof(decltype(formattedVertices)::value_type)), formattedVertices.data(), GL_STATIC_DRAW);
-
-	std::vector<glm::vec4> vertexDataEdgeShader;
-	std::vector<glm::uvec3> faceDataEdgeShader;
-	prepareEdgeShaderData(vertexDataEdgeShader, faceDataEdgeShader);
-
-	std::vector<glm::vec3> only_vertices = getVertices();
-	glBindVertexArray(m_vao_edges);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_edges);
-	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertexDataEdgeShader.size() * sizeof(decltype(vertexDataEdgeShader)::value_type)), vertexDataEdgeShader.data(), GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_edges);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(faceDataEdgeShader.size() * sizeof(decltype(faceDataEdgeShader)::value_type)), faceDataEdgeShader.data(), GL_STATIC_DRAW);
-
-}
-
 void Origami::normalizeVertices()
 {
 	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max()), max = glm::vec3(std::numeric_limits<float>::min());
 	for (int i = 0; i < vertices.size(); i++) {
-		min = glm::min(min, vertices[i].coords);
-		max = glm::max(max, vertices[i].coords);
+		min = glm::min(min, vertices.coords[i]);
+		max = glm::max(max, vertices.coords[i]);
 	}
 	float maxLength = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
 	min /= maxLength;
 	max /= maxLength;
 	for (int i = 0; i < vertices.size(); i++) {
-		vertices[i].coords = vertices[i].coords / maxLength + (max - min) / 2.0f;
+		vertices.coords[i] = vertices.coords[i] / maxLength + (max - min) / 2.0f;
 	}
 }
 
-void Origami::prepareGpuMesh() {
+glm::vec3 Origami::angles(glm::uvec3 face) const
+{
+	return triangleAngles(vertices.coords[face.x], vertices.coords[face.y], vertices.coords[face.z]);
+}
 
-	updateNormals();
+unsigned int opposite_vertex(glm::uvec3 face, glm::uvec3 edge)
+{
+	if (face.x != edge.x && face.x != edge.y) {
+		return face.x;
+	} else if (face.y != edge.x && face.y != edge.y) {
+		return face.y;
+	} else {
+		return face.z;
+	}
+}
 
-	// Create VAO and bind it so subsequent creations of VBO and IBO are bound to this VAO
-	glGenVertexArrays(1, &m_vao_faces);
-	glBindVertexArray(m_vao_faces);
+static uint64_t vertexPairKey(unsigned int a, unsigned int b)
+{
+	return (uint64_t(std::min(a, b)) << 32) | uint64_t(std::max(a, b));
+}
 
-	// Create vertex buffer object (VBO)
-	glGenBuffers(1, &m_vbo_faces);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_faces);
+void Origami::buildAdjacency()
+{
+	const unsigned int no_face = static_cast<unsigned int>(faces.size());
 
-	// Create index buffer object (IBO)
-	glGenBuffers(1, &m_ibo_faces);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_faces);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(this->faces.size() * sizeof(decltype(this->faces)::value_type)), this->faces.data(), GL_STATIC_DRAW);
+	// look up edges by their (unordered) pair of vertices, so every face only has to check its own three sides
+	std::unordered_map<uint64_t, unsigned int> edge_lookup;
+	edge_lookup.reserve(edges.size());
+	for (unsigned int i = 0; i < edges.size(); i++) {
+		edge_lookup.emplace(vertexPairKey(edges[i].x, edges[i].y), i);
+	}
 
-	// We tell OpenGL what each vertex looks like and how they are mapped to the shader (location = ...).
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, coords));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, force));
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VertexData), (void*)offsetof(VertexData, velocity));
-	glVertexAttribDivisor(0, 0);
-	glVertexAttribDivisor(1, 0);
-	glVertexAttribDivisor(2, 0);
+	std::vector<glm::uvec2> adjacent(edges.size(), glm::uvec2(no_face));
+	for (unsigned int j = 0; j < faces.size(); j++) {
+		const glm::uvec3 face = faces[j];
+		for (glm::uvec2 side : { glm::uvec2(face.x, face.y), glm::uvec2(face.y, face.z), glm::uvec2(face.z, face.x) }) {
+			auto it = edge_lookup.find(vertexPairKey(side.x, side.y));
+			if (it == edge_lookup.end()) {
+				continue;
+			}
+			glm::uvec2& f = adjacent[it->second];
+			if (f.x == no_face) {
+				f.x = j;
+			}
+			else if (f.y == no_face) {
+				f.y = j;
+			}
+			else {
+				std::string msg = "Edge " + std::to_string(it->second) + " is adjacent to more than 2 faces.";
+				throw OrigamiException(msg.c_str());
+			}
+		}
+	}
 
-	std::vector<glm::uvec2> edges_gpu;
-	for (auto e : this->edges) {
-		edges_gpu.push_back(glm::vec2(e.x, e.y));
+	// duplicate edges share the faces found for the first edge between the same two vertices
+	edge_to_faces.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		glm::uvec2 f = adjacent[edge_lookup[vertexPairKey(edges[i].x, edges[i].y)]];
+		if (f.y == no_face) {
+			f.y = f.x;
+		}
+		edge_to_faces[i] = f;
 	}
 
-	// Create VAO and bind it so subsequent creations of VBO and IBO are bound to this VAO
-	glGenVertexArrays(1, &m_vao_edges);
-	glBindVertexArray(m_vao_edges);
+	std::vector<unsigned int> rows, entries;
+	rows.reserve(2 * edges.size());
+	entries.reserve(2 * edges.size());
+	for (unsigned int i = 0; i < edges.size(); i++) {
+		rows.push_back(edges[i].x);
+		entries.push_back(i);
+		rows.push_back(edges[i].y);
+		entries.push_back(i);
+	}
+	vertex_to_edges.build(vertices.size(), rows, entries);
+
+	rows.clear();
+	entries.clear();
+	for (unsigned int j = 0; j < faces.size(); j++) {
+		for (int k = 0; k < 3; k++) {
+			rows.push_back(faces[j][k]);
+			entries.push_back(j);
+		}
+	}
+	vertex_to_faces.build(vertices.size(), rows, entries);
+}
 
-	// Create vertex buffer object (VBO)
-	glGenBuffers(1, &m_vbo_edges);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_edges);
+/// <summary>
+/// Checks if (a, b, c) is the face with the same winding, i.e. a rotation of its three vertices.
+/// </summary>
+static bool sameWinding(glm::uvec3 face, unsigned int a, unsigned int b, unsigned int c)
+{
+	return (face.x == a && face.y == b && face.z == c) ||
+		(face.y == a && face.z == b && face.x == c) ||
+		(face.z == a && face.x == b && face.y == c);
+}
 
-	// Create index buffer object (IBO)
-	glGenBuffers(1, &m_ibo_edges);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_edges);
+void Origami::prepareCreases()
+{
+	creases.clear();
+	for (size_t i = 0; i < edges.size(); i++) {
+		if (edges[i].z == BOUNDARY_EDGE || edge_to_faces[i].x >= faces.size()) {
+			continue;
+		}
+		CreaseData crease;
+		crease.p1 = opposite_vertex(faces[edge_to_faces[i].x], edges[i]);
+		crease.p2 = opposite_vertex(faces[edge_to_faces[i].y], edges[i]);
+		crease.p3 = edges[i].x;
+		crease.p4 = edges[i].y;
+		crease.type = edges[i].z;
+		crease.nominal_length = nominal_length[i];
+		crease.full_target_angle = edges[i].z == FACET_EDGE ? 0.0f : (edges[i].z == MOUNTAIN_EDGE ? -static_cast<float>(M_PI) : static_cast<float>(M_PI));
+		// cross(p4 - p3, p1 - p3) points along the face normal exactly when (p3, p4, p1) has the face's winding
+		crease.n1_sign = sameWinding(faces[edge_to_faces[i].x], crease.p3, crease.p4, crease.p1) ? 1.0f : -1.0f;
+		crease.n2_sign = sameWinding(faces[edge_to_faces[i].y], crease.p3, crease.p4, crease.p2) ? 1.0f : -1.0f;
+		creases.push_back(crease);
+	}
+	// the facet creases first, see facet_crease_count
+	auto folds = std::stable_partition(creases.begin(), creases.end(), [](const CreaseData& crease) { return crease.type == FACET_EDGE; });
+	facet_crease_count = static_cast<size_t>(folds - creases.begin());
+
+	std::vector<unsigned int> rows, slots;
+	for (unsigned int i = 0; i < creases.size(); i++) {
+		for (unsigned int p : { creases[i].p1, creases[i].p2, creases[i].p3, creases[i].p4 }) {
+			rows.push_back(p);
+			slots.push_back(static_cast<unsigned int>(rows.size() - 1));
+		}
+	}
+	vertex_to_creases.build(vertices.size(), rows, slots);
+}
 
-	// We tell OpenGL what each vertex looks like and how they are mapped to the shader (location = ...).
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+void Origami::step() {
+	if (watchdog && m_checkpoint_coords.size() != vertices.size()) {
+		saveWatchdogCheckpoint();
+	}
+	if (fold_ramp) {
+		advanceFoldRamp();
+	}
+	if (spectral_time_step) {
+		updateSpectralTimeStep();
+	}
+	if (solver == SOLVER_IMPLICIT) {
+		stepImplicit();
+	} else if (solver == SOLVER_RELAXATION) {
+		stepRelaxation();
+	} else if (solver == SOLVER_XPBD) {
+		stepXpbd();
+	} else if (doublePrecisionActive()) {
+		loadDoubleVertices();
+		stepExplicit<double>();
+	} else {
+		stepExplicit<float>();
+	}
+	if (!active_set || solver != SOLVER_EXPLICIT || adaptive_time_step || multirate) {
+		// the vertices moved without the active set knowing, so all of them start awake next time
+		m_awake.clear();
+	}
+	updateConvergence();
+	if (watchdog) {
+		checkWatchdog();
+	}
+}
 
-	// update the data in the buffers
-	updateVertexBuffers();
+void Origami::updateConvergence()
+{
+	if (solver == SOLVER_XPBD && convergence_force > 0.0f && !m_force_cache_used) {
+		computeTotalForce();
+	}
+	const bool forcesKnown = solver != SOLVER_XPBD || convergence_force > 0.0f;
+	double kineticEnergy = 0.0;
+	float maxVelocitySq = 0.0f;
+	float maxForceSq = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const float velocitySq = glm::dot(vertices.velocity[i], vertices.velocity[i]);
+		kineticEnergy += 0.5 * double(velocitySq);
+		maxVelocitySq = std::max(maxVelocitySq, velocitySq);
+		if (forcesKnown) {
+			maxForceSq = std::max(maxForceSq, glm::dot(vertices.force[i], vertices.force[i]));
+		}
+	}
+	convergence.kinetic_energy = kineticEnergy;
+	convergence.max_velocity = std::sqrt(maxVelocitySq);
+	convergence.max_force = solver == SOLVER_RELAXATION ? last_residual : std::sqrt(maxForceSq);
+	convergence.steps++;
+
+	// std::max skips NaNs, but the sum of the kinetic energy does not
+	if (!std::isfinite(kineticEnergy) || !std::isfinite(convergence.max_force)) {
+		convergence.diverged = true;
+	}
+	bool settled;
+	if (solver == SOLVER_RELAXATION) {
+		settled = last_residual < relaxation_tolerance;
+	} else {
+		settled = (convergence_velocity <= 0.0f || convergence.max_velocity < convergence_velocity)
+			&& (convergence_force <= 0.0f || convergence.max_force < convergence_force)
+			&& (convergence_velocity > 0.0f || convergence_force > 0.0f);
+	}
+	const bool ramping = fold_ramp && target_angle_percent != fold_ramp_target;
+	convergence.settled_steps = settled && !convergence.diverged && !ramping ? convergence.settled_steps + 1 : 0;
+	convergence.converged = convergence.settled_steps >= convergence_steps;
 }
 
-float Origami::cot(unsigned int p1, unsigned int p2, unsigned int p3)
+void Origami::resetConvergence()
 {
-	glm::vec3 a = vertices[p2].coords - vertices[p1].coords;
-	glm::vec3 b = vertices[p3].coords - vertices[p1].coords;
-	return glm::dot(a, b) / glm::length(glm::cross(a, b));
+	convergence.settled_steps = 0;
+	convergence.converged = false;
+	m_awake.clear();
+	// the cached forces may be for the old fold percent or stiffnesses
+	m_force_cache_used = false;
 }
 
-glm::vec3 Origami::angles(glm::uvec3 face)
+void Origami::advanceFoldRamp()
 {
-	glm::vec3 vYX = glm::normalize(vertices[face.y].coords - vertices[face.x].coords);
-	glm::vec3 vZX = glm::normalize(vertices[face.z].coords - vertices[face.x].coords);
-	glm::vec3 vZY = glm::normalize(vertices[face.z].coords - vertices[face.y].coords);
-	return glm::vec3(
-		std::acos(std::clamp(glm::dot(vYX, vZX), -1.0f, 1.0f)),
-		std::acos(std::clamp(glm::dot(-vYX, vZY), -1.0f, 1.0f)),
-		std::acos(std::clamp(glm::dot(-vZX, -vZY), -1.0f, 1.0f)) // yes I can cancel the -, but this is clearer
-	);
+	if (target_angle_percent == fold_ramp_target) {
+		m_fold_ramp_counter = 0;
+		return;
+	}
+	if (m_fold_ramp_counter % FOLD_RAMP_INTERVAL == 0) {
+		// the force pass of the last step already found them if it gathered stats
+		if (gather_constraint_stats && constraint_stats.steps + 1 >= convergence.steps && enable_axial_constraints && enable_face_constraints) {
+			ramp_strain = constraint_stats.max_strain;
+			ramp_face_error = constraint_stats.max_face_error;
+		} else {
+			ramp_strain = maxAxialStrain();
+			ramp_face_error = maxFaceAngleError();
+		}
+		// aim for 80% of the tighter limit, the rate only takes effect on the strain some steps later
+		const float load = std::max(ramp_strain / std::max(ramp_max_strain, 1e-6f), ramp_face_error / std::max(ramp_max_face_error, 1e-6f));
+		if (load >= 1.0f) {
+			// hold the fold until the origami has caught up, it starts again from the minimum rate
+			fold_ramp_rate = 0.0f;
+		} else {
+			const float factor = load > 0.0f ? std::clamp(0.8f / load, 0.5f, 1.2f) : 1.2f;
+			const float rate = fold_ramp_rate > 0.0f ? fold_ramp_rate * factor : fold_ramp_min_rate;
+			fold_ramp_rate = std::clamp(rate, fold_ramp_min_rate, std::max(fold_ramp_min_rate, fold_ramp_max_rate));
+		}
+	}
+	m_fold_ramp_counter++;
+	if (fold_ramp_rate == 0.0f) {
+		return;
+	}
+
+	// the rate is per explicit step, the implicit and XPBD solvers cover more time in one step
+	const float increment = fold_ramp_rate * (solver == SOLVER_IMPLICIT ? implicit_time_step_scale : solver == SOLVER_XPBD ? xpbd_time_step_scale : 1.0f);
+	if (target_angle_percent < fold_ramp_target) {
+		target_angle_percent = std::min(fold_ramp_target, target_angle_percent + increment);
+	} else {
+		target_angle_percent = std::max(fold_ramp_target, target_angle_percent - increment);
+	}
+	// forces kept from the last step belong to the old fold percent
+	m_force_cache_used = false;
 }
 
-std::vector<Origami::VertexData> Origami::formatVertices()
+void Origami::saveWatchdogCheckpoint()
 {
-	return vertices;
+	const auto n = static_cast<std::ptrdiff_t>(vertices.size());
+	m_checkpoint_coords.assign(vertices.coords.begin(), vertices.coords.begin() + n);
+	m_checkpoint_velocity.assign(vertices.velocity.begin(), vertices.velocity.begin() + n);
+	m_checkpoint_target_angle_percent = target_angle_percent;
+	m_checkpoint_fold_ramp_rate = fold_ramp_rate;
+	m_checkpoint_kinetic_energy = convergence.kinetic_energy;
+	m_watchdog_counter = 0;
 }
 
-void Origami::prepareEdgeShaderData(std::vector<glm::vec4>& vertexData, std::vector<glm::uvec3>& faceData)
+void Origami::checkWatchdog()
 {
-	const float width = 2.5e-3f;
-	vertexData.clear();
-	faceData.clear();
-	for (int i = 0; i < edges.size(); i++) {
-		glm::vec3 meanN = normals[edge_to_faces[i].x] + normals[edge_to_faces[i].y];
-		glm::vec3 dir1 = vertices[edges[i].y].coords - vertices[edges[i].x].coords;
-		glm::vec3 dir2 = glm::cross(dir1, meanN);
-		dir1 = width * glm::normalize(dir1);
-		dir2 = width * glm::normalize(dir2);
-		meanN = width * 1.0f * glm::normalize(meanN); // add meanN to prevent Z fighting
-		vertexData.push_back(glm::vec4(vertices[edges[i].x].coords - dir2 + meanN, float(edges[i].z))); //- dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].y].coords - dir2 + meanN, float(edges[i].z)));	//+ dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].y].coords + dir2 + meanN, float(edges[i].z)));	//+ dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].x].coords + dir2 + meanN, float(edges[i].z)));	//- dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].x].coords - dir2 - meanN, float(edges[i].z)));	//- dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].y].coords - dir2 - meanN, float(edges[i].z)));	//+ dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].y].coords + dir2 - meanN, float(edges[i].z)));	//+ dir1 
-		vertexData.push_back(glm::vec4(vertices[edges[i].x].coords + dir2 - meanN, float(edges[i].z)));	//- dir1 
-		faceData.push_back(glm::uvec3(8*i, 8*i+1, 8*i+2));
-		faceData.push_back(glm::uvec3(8*i, 8*i+2, 8*i+3));
-		faceData.push_back(glm::uvec3(8*i+4, 8*i+5, 8*i+6));
-		faceData.push_back(glm::uvec3(8*i+4, 8*i+6, 8*i+7));
-
-		faceData.push_back(glm::uvec3(8 * i + 0, 8 * i + 1, 8 * i + 5));
-		faceData.push_back(glm::uvec3(8 * i + 0, 8 * i + 5, 8 * i + 4));
-		faceData.push_back(glm::uvec3(8 * i + 2, 8 * i + 3, 8 * i + 7));
-		faceData.push_back(glm::uvec3(8 * i + 2, 8 * i + 7, 8 * i + 6));
-
-		faceData.push_back(glm::uvec3(8 * i + 0, 8 * i + 3, 8 * i + 7));
-		faceData.push_back(glm::uvec3(8 * i + 0, 8 * i + 4, 8 * i + 7));
-		faceData.push_back(glm::uvec3(8 * i + 1, 8 * i + 2, 8 * i + 6));
-		faceData.push_back(glm::uvec3(8 * i + 1, 8 * i + 5, 8 * i + 6));
-	}
-}
-
-void Origami::updateNormals()
-{
-	normals.clear();
-	for (int i = 0; i < faces.size(); i++) {
-		normals.push_back(glm::normalize(glm::cross(vertices[faces[i].y].coords - vertices[faces[i].x].coords, vertices[faces[i].z].coords - vertices[faces[i].x].coords)));
+	// non-finite values are caught after every step, that costs nothing since updateConvergence finds them anyway
+	bool failed = convergence.diverged;
+	if (!failed && ++m_watchdog_counter < watchdog_interval) {
+		return;
+	}
+	if (!failed) {
+		// the checkpoint's shape is measured at the current fold percent, which covers what the fold ramp or the
+		// user put in since
+		const double budget = std::max(m_checkpoint_kinetic_energy + constraintEnergy(m_checkpoint_coords), WATCHDOG_MIN_ENERGY);
+		const double energy = convergence.kinetic_energy + constraintEnergy(std::span<const glm::vec3>(vertices.coords.data(), vertices.size()));
+		if (energy <= budget) {
+			saveWatchdogCheckpoint();
+			return;
+		}
+		// keep the checkpoint from before the energy started to grow
+		failed = energy > double(watchdog_energy_growth) * budget;
+		if (!failed) {
+			m_watchdog_counter = 0;
+			return;
+		}
+	}
+	if (rollbacks >= watchdog_max_rollbacks) {
+		convergence.diverged = true;
+		return;
+	}
+
+	rollbacks++;
+	std::copy(m_checkpoint_coords.begin(), m_checkpoint_coords.end(), vertices.coords.begin());
+	std::copy(m_checkpoint_velocity.begin(), m_checkpoint_velocity.end(), vertices.velocity.begin());
+	if (fold_ramp) {
+		// the fold percent was set by the ramp, not by the user
+		target_angle_percent = m_checkpoint_target_angle_percent;
+		fold_ramp_rate = 0.5f * m_checkpoint_fold_ramp_rate;
+	}
+	deltaT *= 0.5f;
+	if (spectral_time_step) {
+		// or the next estimate sets it back
+		time_step_safety *= 0.5f;
 	}
+	// the adaptive solver starts over from the new deltaT
+	m_adaptive_time_step = 0.0f;
+	convergence.diverged = false;
+	convergence.kinetic_energy = m_checkpoint_kinetic_energy;
+	resetConvergence();
+	m_watchdog_counter = 0;
 }
 
-unsigned int opposite_vertex(glm::uvec3 face, glm::uvec3 edge)
+double Origami::constraintEnergy(std::span<const glm::vec3> coords)
 {
-	if (face.x != edge.x && face.x != edge.y) {
-		return face.x;
-	} else if (face.y != edge.x && face.y != edge.y) {
-		return face.y;
-	} else {
-		return face.z;
+	constraint_evaluations += (enable_axial_constraints ? edges.size() : 0) + (enable_crease_constraints ? creases.size() : 0)
+		+ (enable_face_constraints ? faces.size() : 0);
+	double energy = 0.0;
+	if (enable_axial_constraints) {
+		for (size_t i = 0; i < edges.size(); i++) {
+			const float stretch = glm::length(coords[edges[i].x] - coords[edges[i].y]) - nominal_length[i];
+			energy += double(0.5f * EA / nominal_length[i] * stretch * stretch);
+		}
+	}
+	if (enable_crease_constraints) {
+		glm::vec3 gradient[4];
+		for (const CreaseData& crease : creases) {
+			const float error = ::creaseAngleError(coords[crease.p1], coords[crease.p2], coords[crease.p3], coords[crease.p4],
+				crease.n1_sign, crease.n2_sign, crease.full_target_angle * target_angle_percent, gradient);
+			energy += double(0.5f * creaseStiffness(crease) * error * error);
+		}
+	}
+	if (enable_face_constraints) {
+		for (size_t i = 0; i < faces.size(); i++) {
+			const glm::vec3 error = triangleAngles(coords[faces[i].x], coords[faces[i].y], coords[faces[i].z]) - nominal_angles[i];
+			energy += double(0.5f * k_face * glm::dot(error, error));
+		}
 	}
+	return energy;
 }
 
-void Origami::step() {
-	updateNormals();
-	std::vector<glm::vec3> totalForce = getTotalForce();
-	for (int i = 0; i < vertices.size(); i++) {
-		vertices[i].force = totalForce[i];
-		glm::vec3 a = totalForce[i];
-		vertices[i].velocity += a * deltaT;
-		vertices[i].coords += vertices[i].velocity * deltaT;
+template<typename T>
+void Origami::stepExplicit()
+{
+	if (adaptive_time_step) {
+		stepAdaptive<T>();
+	} else if (multirate) {
+		stepMultirate<T>();
+	} else if (active_set) {
+		stepActiveSet<T>();
+	} else {
+		integrateExplicit<T>(deltaT);
 	}
-	m_force_cache_used = false;
 }
 
-void Origami::calculateOptimalTimeStep()
+void Origami::prepareDoubleRestShape()
 {
-	// calculate optimal time step
-	float maxfreq = 0.0f;
-	for (int i = 0; i < edges.size(); i++) {
+	m_double_nominal_length.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		m_double_nominal_length[i] = glm::length(glm::dvec3(vertices.coords[edges[i].x]) - glm::dvec3(vertices.coords[edges[i].y]));
+	}
+	m_double_nominal_angles.resize(faces.size());
+	for (size_t i = 0; i < faces.size(); i++) {
+		m_double_nominal_angles[i] = triangleAngles(glm::dvec3(vertices.coords[faces[i].x]), glm::dvec3(vertices.coords[faces[i].y]),
+			glm::dvec3(vertices.coords[faces[i].z]));
+	}
+	// the edge constants depend on the rest lengths
+	m_double_buffers.edge_constants = EdgeConstants<double>();
+}
 
-		float k_axial = EA / nominal_length[i];
-		float freq = std::sqrt(k_axial);
-		if (freq > maxfreq) {
-			maxfreq = freq;
+void Origami::loadDoubleVertices()
+{
+	if (m_double_nominal_length.size() != edges.size() || m_double_nominal_angles.size() != faces.size()) {
+		// not loaded from a file, only the float rest shape is known
+		m_double_nominal_length.assign(nominal_length.begin(), nominal_length.end());
+		m_double_nominal_angles.assign(nominal_angles.begin(), nominal_angles.end());
+		m_double_buffers.edge_constants = EdgeConstants<double>();
+	}
+	// The float vertices are the double ones rounded, unless something else moved them. Those vertices start
+	// over from the float values, and the double forces no longer belong to the positions.
+	const size_t n = vertices.size();
+	m_double_vertices.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		if (glm::vec3(m_double_vertices.coords[i]) != vertices.coords[i] || glm::vec3(m_double_vertices.velocity[i]) != vertices.velocity[i]) {
+			m_double_vertices.coords[i] = vertices.coords[i];
+			m_double_vertices.velocity[i] = vertices.velocity[i];
+			m_force_cache_used = false;
 		}
 	}
-
-	deltaT = 1.0f / (2.0f * M_PI * maxfreq);
 }
 
-std::vector<glm::vec3> Origami::axialConstraints()
+void Origami::storeDoubleVertices(size_t begin, size_t end)
 {
-	std::vector<glm::vec3> forces(this->vertices.size(), glm::vec3(0));
-
-	for (int i = 0; i < edges.size(); i++) {
-		float l = glm::length(vertices[edges[i].x].coords - vertices[edges[i].y].coords);
-		glm::vec3 dldp1 = glm::normalize(vertices[edges[i].x].coords - vertices[edges[i].y].coords);
-		glm::vec3 dldp2 = -dldp1;
-		float k_axial = EA / nominal_length[i];
-		forces[edges[i].x] -= k_axial * (l - nominal_length[i]) * dldp1;
-		forces[edges[i].y] -= k_axial * (l - nominal_length[i]) * dldp2;
+	for (size_t i = begin; i < end; i++) {
+		vertices.coords[i] = m_double_vertices.coords[i];
+		vertices.velocity[i] = m_double_vertices.velocity[i];
+		vertices.force[i] = m_double_vertices.force[i];
 	}
-
-	return forces;
 }
 
-std::vector<glm::vec3> Origami::creaseConstraints()
+template<typename T>
+void Origami::integrateExplicit(float dt)
 {
-	std::vector<glm::vec3> forces(this->vertices.size(), glm::vec3(0));
-
-	for (int i = 0; i < this->edges.size(); i++) {
-		if (this->edges[i].z == BOUNDARY_EDGE) {
-			continue;
+	// the forces at the current positions may already be known if they were requested for drawing
+	if (!forcesCached<T>()) {
+		computeTotalForce<T>();
+	}
+	VertexArrays<T>& state = vertexState<T>();
+	auto integrate = [this, &state, dt](size_t begin, size_t end) {
+		const T h = dt;
+		for (size_t i = begin; i < end; i++) {
+			Vec3<T> a = state.force[i];
+			state.velocity[i] += a * h;
+			state.coords[i] += state.velocity[i] * h;
+		}
+		if constexpr (!std::is_same_v<T, float>) {
+			storeDoubleVertices(begin, end);
 		}
-		const float k_crease = this->edges[i].z == FACET_EDGE ? nominal_length[i] * k_facet : nominal_length[i] * k_fold;
-		// TODO: Update this so that it's controllable
-		float theta_target = this->edges[i].z == FACET_EDGE ? 0 : (this->edges[i].z == MOUNTAIN_EDGE ? -M_PI : M_PI);
-		theta_target *= target_angle_percent;
-
-		unsigned int f1 = edge_to_faces[i].x;
-		unsigned int f2 = edge_to_faces[i].y;
-		unsigned int p1 = opposite_vertex(faces[f1], edges[i]);
-		unsigned int p2 = opposite_vertex(faces[f2], edges[i]);
-		unsigned int p3 = edges[i].x;
-		unsigned int p4 = edges[i].y;
-
-		glm::vec3 n1 = normals[f1];
-		glm::vec3 n2 = normals[f2];
-		float h1 = areaOfTriangle(vertices[faces[f1].x].coords, vertices[faces[f1].y].coords, vertices[faces[f1].z].coords) * 2.0f / glm::length(vertices[p4].coords - vertices[p3].coords);
-		float h2 = areaOfTriangle(vertices[faces[f2].x].coords, vertices[faces[f2].y].coords, vertices[faces[f2].z].coords) * 2.0f / glm::length(vertices[p4].coords - vertices[p3].coords);
-		glm::vec3 dthdp1 = n1 / h1;
-		glm::vec3 dthdp2 = n2 / h2;
-		glm::vec3 dthdp3 = -(cot(p4, p3, p1) / (cot(p3, p1, p4) + cot(p4, p3, p1))) * n1 / h1 - (cot(p4, p2, p3) / (cot(p3, p4, p2) + cot(p4, p2, p3))) * n2 / h2;
-		glm::vec3 dthdp4 = -(cot(p3, p1, p4) / (cot(p3, p1, p4) + cot(p4, p3, p1))) * n1 / h1 - (cot(p3, p4, p2) / (cot(p3, p4, p2) + cot(p4, p2, p3))) * n2 / h2;
-
-		glm::vec3 p1proj = vertices[p1].coords - (vertices[p3].coords + glm::normalize(vertices[p4].coords - vertices[p3].coords) * std::sqrtf(std::abs(std::pow(glm::length(vertices[p3].coords - vertices[p1].coords), 2) - h1*h1)));
-		glm::vec3 p2proj = vertices[p2].coords - (vertices[p3].coords + glm::normalize(vertices[p4].coords - vertices[p3].coords) * std::sqrtf(std::abs(std::pow(glm::length(vertices[p3].coords - vertices[p2].coords), 2) - h2*h2)));
-		
-		
-		//glm::vec3 creaseVector = glm::normalize(vertices[p4].coords - vertices[p3].coords);
-		//float dotNormals = glm::dot(n1, n2);
-		//float theta = std::atan2(glm::dot(glm::cross(n1, creaseVector), n2), dotNormals);
-		float theta = std::acos(std::clamp(glm::dot(-p1proj, p2proj) / (h1 * h2), -1.0f, 1.0f));
-		// flip orientation based on normals if needed
-		if (glm::dot(n1, p1proj + p2proj) < 0) {
-			theta *= -1.0f;
-		}
-
-		while (theta_target - theta > M_PI) {
-			theta += 2 * M_PI;
-		}
-		while (theta - theta_target > M_PI) {
-			theta -= 2 * M_PI;
-		}
-
-		// apply forces
-		forces[p1] -= k_crease * (theta - theta_target) * dthdp1;
-		forces[p2] -= k_crease * (theta - theta_target) * dthdp2;
-		forces[p3] -= k_crease * (theta - theta_target) * dthdp3;
-		forces[p4] -= k_crease * (theta - theta_target) * dthdp4;
-
-		//std::cout << i << ": " << theta << " " << theta_target << std::endl;
-		
-		/*std::cout << "------------------" << std::endl;
-		std::cout << vertices[p1].x << " " << vertices[p1].y << " " << vertices[p1].z << std::endl;
-		std::cout << vertices[p3].x << " " << vertices[p3].y << " " << vertices[p3].z << std::endl;
-		std::cout << vertices[p4].x << " " << vertices[p4].y << " " << vertices[p4].z << std::endl;
-		std::cout << areaOfTriangle(vertices[faces[f1].x], vertices[faces[f1].y], vertices[faces[f1].z]) << std::endl;
-		std::cout << p1 << " " << p2 << " " << p3 << " " << p4 << std::endl;
-		std::cout << n1.x << " " << n1.y << " " << n1.z << std::endl;
-		std::cout << n2.x << " " << n2.y << " " << n2.z << std::endl;
-		std::cout << h1 << " " << h2 << std::endl;
-		std::cout << p1proj.x << " " << p1proj.y << " " << p1proj.z << std::endl;
-		std::cout << p2proj.x << " " << p2proj.y << " " << p2proj.z << std::endl;
-		std::cout << theta << std::endl;
-		std::cout << forces[p1].x << " " << forces[p1].y << " " << forces[p1].z << std::endl;
-		std::cout << forces[p2].x << " " << forces[p2].y << " " << forces[p2].z << std::endl;
-		std::cout << forces[p3].x << " " << forces[p3].y << " " << forces[p3].z << std::endl;
-		std::cout << forces[p4].x << " " << forces[p4].y << " " << forces[p4].z << std::endl;*/
+	};
+	if (num_threads > 1) {
+		threadPool().parallelFor(state.size(), integrate);
+	} else {
+		integrate(0, state.size());
 	}
-	return forces;
+	m_force_cache_used = false;
 }
 
-std::vector<glm::vec3> Origami::faceConstraints()
+template<typename T>
+void Origami::stepAdaptive()
 {
-	std::vector<glm::vec3> forces(this->vertices.size(), glm::vec3(0));
+	VertexArrays<T>& state = vertexState<T>();
+	SolverBuffers<T>& buffers = solverBuffers<T>();
+	const size_t n = state.size();
+	const float maxTimeStep = deltaT * adaptive_max_time_step_scale;
+	// far below deltaT the error can only come from the tolerance being unreachable, so give up on it there
+	const float minTimeStep = deltaT / 64.0f;
+	if (m_adaptive_time_step <= 0.0f) {
+		m_adaptive_time_step = deltaT;
+	}
+	m_adaptive_time_step = std::clamp(m_adaptive_time_step, minTimeStep, maxTimeStep);
 
-	for (int i = 0; i < faces.size(); i++) {
-		glm::vec3 n = normals[i];
-		glm::vec3 angles = this->angles(faces[i]);
-		const unsigned int p1 = faces[i].x;
-		const unsigned int p2 = faces[i].y;
-		const unsigned int p3 = faces[i].z;
-		glm::vec3 dp1a231 = glm::cross(n, vertices[p1].coords - vertices[p2].coords) / std::powf(glm::length(vertices[p1].coords - vertices[p2].coords), 2);
-		glm::vec3 dp3a231 = -glm::cross(n, vertices[p3].coords - vertices[p2].coords) / std::powf(glm::length(vertices[p3].coords - vertices[p2].coords), 2);
-		glm::vec3 dp2a231 = -dp1a231 - dp3a231;
-
-		glm::vec3 dp2a312 = glm::cross(n, vertices[p2].coords - vertices[p3].coords) / std::powf(glm::length(vertices[p2].coords - vertices[p3].coords), 2);
-		glm::vec3 dp1a312 = -glm::cross(n, vertices[p1].coords - vertices[p3].coords) / std::powf(glm::length(vertices[p1].coords - vertices[p3].coords), 2);
-		glm::vec3 dp3a312 = -dp2a312 - dp1a312;
-
-		glm::vec3 dp3a123 = glm::cross(n, vertices[p3].coords - vertices[p1].coords) / std::powf(glm::length(vertices[p3].coords - vertices[p1].coords), 2);
-		glm::vec3 dp2a123 = -glm::cross(n, vertices[p2].coords - vertices[p1].coords) / std::powf(glm::length(vertices[p2].coords - vertices[p1].coords), 2);
-		glm::vec3 dp1a123 = -dp3a123 - dp2a123;
-
-		/*std::cout << "------------------" << std::endl;
-		std::cout << dp1a231.x << " " << dp1a231.y << " " << dp1a231.z << std::endl;
-		std::cout << dp3a231.x << " " << dp3a231.y << " " << dp3a231.z << std::endl;
-		std::cout << dp2a231.x << " " << dp2a231.y << " " << dp2a231.z << std::endl;
-		std::cout << dp2a312.x << " " << dp2a312.y << " " << dp2a312.z << std::endl;
-		std::cout << dp1a312.x << " " << dp1a312.y << " " << dp1a312.z << std::endl;
-		std::cout << dp3a312.x << " " << dp3a312.y << " " << dp3a312.z << std::endl;
-		std::cout << dp3a123.x << " " << dp3a123.y << " " << dp3a123.z << std::endl;
-		std::cout << dp2a123.x << " " << dp2a123.y << " " << dp2a123.z << std::endl;
-		std::cout << dp1a123.x << " " << dp1a123.y << " " << dp1a123.z << std::endl;*/
-
-		forces[p1] -= k_face * (angles.x - nominal_angles[i].x) * dp1a123;
-		forces[p1] -= k_face * (angles.y - nominal_angles[i].y) * dp1a231;
-		forces[p1] -= k_face * (angles.z - nominal_angles[i].z) * dp1a312;
-
-		forces[p2] -= k_face * (angles.x - nominal_angles[i].x) * dp2a123;
-		forces[p2] -= k_face * (angles.y - nominal_angles[i].y) * dp2a231;
-		forces[p2] -= k_face * (angles.z - nominal_angles[i].z) * dp2a312;
-
-		forces[p3] -= k_face * (angles.x - nominal_angles[i].x) * dp3a123;
-		forces[p3] -= k_face * (angles.y - nominal_angles[i].y) * dp3a231;
-		forces[p3] -= k_face * (angles.z - nominal_angles[i].z) * dp3a312;
+	if (!forcesCached<T>()) {
+		computeTotalForce<T>();
 	}
+	buffers.start_coords.assign(state.coords.begin(), state.coords.begin() + static_cast<std::ptrdiff_t>(n));
+	buffers.start_velocity.assign(state.velocity.begin(), state.velocity.begin() + static_cast<std::ptrdiff_t>(n));
+	buffers.start_force.assign(state.force.begin(), state.force.begin() + static_cast<std::ptrdiff_t>(n));
+
+	bool rejected = false;
+	while (true) {
+		const float h = m_adaptive_time_step;
+		integrateExplicit<T>(h);
+		// The forces at the end of the step are needed by the next step anyway. With them, velocity Verlet
+		// would have moved the vertices by h^2 / 2 (f1 - f0) less, which is used as the error estimate of the
+		// step, so the estimate costs no extra force evaluation.
+		computeTotalForce<T>();
+		float error = 0.0f;
+		double forceChangeSq = 0.0;
+		double moveSq = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			const Vec3<T> forceChange = state.force[i] - buffers.start_force[i];
+			const Vec3<T> move = state.coords[i] - buffers.start_coords[i];
+			error = std::max(error, float(glm::length(forceChange)));
+			forceChangeSq += double(glm::dot(forceChange, forceChange));
+			moveSq += double(glm::dot(move, move));
+		}
+		error *= 0.5f * h * h;
+
+		// The local error of symplectic Euler goes with h^2. Near the stability limit of the stiffest modes a
+		// plain controller keeps growing the time step into it and getting rejected, so the growth also depends
+		// on whether the error went up since the last step (Gustafsson's PI controller).
+		const float ratio = error / adaptive_tolerance;
+		if (ratio <= 1.0f || h <= minTimeStep) {
+			accepted_steps++;
+			last_time_step = h;
+			const float previous = std::max(m_last_error_ratio, 1e-4f);
+			const float current = std::max(ratio, 1e-4f);
+			float scale = 0.9f * std::pow(current, -0.35f) * std::pow(previous, 0.2f);
+			// right after a rejection the time step is close to the limit, growing it again would only lead to
+			// the next rejection
+			scale = std::clamp(scale, 0.2f, rejected ? 1.0f : 2.0f);
+			m_last_error_ratio = ratio;
+
+			// Just above the stability limit a mode that flips its sign every step slowly grows out of the
+			// rounding errors, and the error estimate alone would keep it at an amplitude of about
+			// adaptive_tolerance instead of getting rid of it. Once such a mode dominates the motion, the force
+			// change over the step divided by the distance moved is about its stiffness k, and the time step is
+			// kept where h^2 k leaves room for the damping (Hairer's stiffness detection).
+			float ceiling = maxTimeStep;
+			if (forceChangeSq > 0.0 && moveSq > 0.0) {
+				ceiling = float(std::sqrt(1.5 / std::sqrt(forceChangeSq / moveSq)));
+			}
+			m_adaptive_time_step = std::min({ h * scale, maxTimeStep, ceiling });
+			return;
+		}
 
-	return forces;
+		rejected = true;
+		rejected_steps++;
+		std::copy(buffers.start_coords.begin(), buffers.start_coords.end(), state.coords.begin());
+		std::copy(buffers.start_velocity.begin(), buffers.start_velocity.end(), state.velocity.begin());
+		std::copy(buffers.start_force.begin(), buffers.start_force.end(), state.force.begin());
+		if constexpr (!std::is_same_v<T, float>) {
+			storeDoubleVertices(0, n);
+		}
+		m_force_cache_used = true;
+		// a non-finite error means the step blew up
+		const float shrink = std::isfinite(ratio) ? std::max(0.9f / std::sqrt(ratio), 0.2f) : 0.2f;
+		m_adaptive_time_step = std::max(h * shrink, minTimeStep);
+	}
 }
 
-std::vector<glm::vec3> Origami::dampingForce()
+void Origami::prepareMultirate()
 {
-	std::vector<glm::vec3> forces(this->vertices.size(), glm::vec3(0));
-	for (int i = 0; i < edges.size(); i++) {
-		float c = 2 * damping_ratio * std::sqrtf(EA / nominal_length[i]);
-		forces[edges[i].x] += c * (vertices[edges[i].y].velocity - vertices[edges[i].x].velocity);
-		forces[edges[i].y] += c * (vertices[edges[i].x].velocity - vertices[edges[i].y].velocity);
+	const int levels = std::max(1, multirate_levels);
+	if (m_multirate_vertex_level.size() == vertices.size() && m_multirate_edges.indices.size() == edges.size()
+		&& m_multirate_creases.indices.size() == creases.size() && m_multirate_faces.indices.size() == faces.size()
+		&& m_multirate_built_levels == levels) {
+		return;
 	}
-	return forces;
+
+	// deltaT is stable for the stiffest edge, EA over the shortest nominal length, and an edge with stiffness k
+	// is just as stable at sqrt(k_max / k) = sqrt(nominal_length / shortest) times that
+	float shortest = std::numeric_limits<float>::max();
+	for (float length : nominal_length) {
+		shortest = std::min(shortest, length);
+	}
+	const unsigned int top = static_cast<unsigned int>(levels - 1);
+	m_multirate_vertex_level.assign(vertices.size(), top);
+	for (size_t i = 0; i < edges.size(); i++) {
+		const float ratio = std::sqrt(nominal_length[i] / shortest);
+		unsigned int level = 0;
+		while (level < top && float(2u << level) <= ratio) {
+			level++;
+		}
+		m_multirate_vertex_level[edges[i].x] = std::min(m_multirate_vertex_level[edges[i].x], level);
+		m_multirate_vertex_level[edges[i].y] = std::min(m_multirate_vertex_level[edges[i].y], level);
+	}
+	m_multirate_max_level = 0;
+	for (unsigned int level : m_multirate_vertex_level) {
+		m_multirate_max_level = std::max(m_multirate_max_level, level);
+	}
+
+	auto group = [this](CsrTable& table, size_t size, auto&& level) {
+		std::vector<unsigned int> levelOf(size);
+		std::vector<unsigned int> indices(size);
+		for (size_t i = 0; i < size; i++) {
+			levelOf[i] = level(i);
+			indices[i] = static_cast<unsigned int>(i);
+		}
+		table.build(m_multirate_max_level + 1, levelOf, indices);
+	};
+	const std::vector<unsigned int>& vertexLevel = m_multirate_vertex_level;
+	group(m_multirate_vertices, vertices.size(), [&](size_t i) { return vertexLevel[i]; });
+	group(m_multirate_edges, edges.size(), [&](size_t i) { return std::min(vertexLevel[edges[i].x], vertexLevel[edges[i].y]); });
+	group(m_multirate_creases, creases.size(), [&](size_t i) {
+		const CreaseData& c = creases[i];
+		return std::min({ vertexLevel[c.p1], vertexLevel[c.p2], vertexLevel[c.p3], vertexLevel[c.p4] });
+	});
+	group(m_multirate_faces, faces.size(), [&](size_t i) {
+		return std::min({ vertexLevel[faces[i].x], vertexLevel[faces[i].y], vertexLevel[faces[i].z] });
+	});
+	m_multirate_step = 0;
+	m_multirate_built_levels = levels;
 }
 
-std::vector<glm::vec3> Origami::getTotalForce()
+template<typename T>
+void Origami::stepMultirate()
 {
-	if (m_force_cache_used) {
-		return m_total_force_cache;
+	prepareMultirate();
+	updateEdgeConstants<T>();
+	VertexArrays<T>& state = vertexState<T>();
+
+	// the steps of level l start at every 2^l-th step of the cycle, and those of all lower levels with them
+	unsigned int due = 0;
+	while (due < m_multirate_max_level && (m_multirate_step >> due & 1u) == 0) {
+		due++;
 	}
-	m_total_force_cache = std::vector(vertices.size(), glm::vec3(0));
-	if (enable_axial_constraints) {
-		std::vector<glm::vec3> axialForces = this->axialConstraints();
-		for (int i = 0; i < vertices.size(); i++) m_total_force_cache[i] += axialForces[i];
+	m_multirate_step = (m_multirate_step + 1) & ((1u << m_multirate_max_level) - 1u);
+
+	// Only the vertices starting a step get a new force. The constraints around them see the other vertices
+	// where they are now, part of the way through their own step.
+	const std::span<const unsigned int> starting(m_multirate_vertices.indices.data(), m_multirate_vertices.offsets[due + 1]);
+	for (unsigned int v : starting) {
+		state.force[v] = Vec3<T>(0);
+	}
+	auto add = [this, &state, due](unsigned int v, const Vec3<T>& f) {
+		if (m_multirate_vertex_level[v] <= due) {
+			state.force[v] += f;
+		}
+	};
+	const bool damping = dampingForceEnabled();
+	if (enable_axial_constraints || damping) {
+		const unsigned int end = m_multirate_edges.offsets[due + 1];
+		for (unsigned int k = 0; k < end; k++) {
+			const unsigned int i = m_multirate_edges.indices[k];
+			const Vec3<T> f = edgeForce<T>(i, enable_axial_constraints, damping);
+			add(edges[i].x, f);
+			add(edges[i].y, -f);
+		}
+		constraint_evaluations += end;
 	}
+	Vec3<T> f[4];
 	if (enable_crease_constraints) {
-		std::vector<glm::vec3> creaseForces = this->creaseConstraints();
-		for (int i = 0; i < vertices.size(); i++) m_total_force_cache[i] += creaseForces[i];
+		const unsigned int end = m_multirate_creases.offsets[due + 1];
+		for (unsigned int k = 0; k < end; k++) {
+			const CreaseData& crease = creases[m_multirate_creases.indices[k]];
+			creaseForce(crease, f);
+			add(crease.p1, f[0]);
+			add(crease.p2, f[1]);
+			add(crease.p3, f[2]);
+			add(crease.p4, f[3]);
+		}
+		constraint_evaluations += end;
 	}
 	if (enable_face_constraints) {
-		std::vector<glm::vec3> faceForces = this->faceConstraints();
-		for (int i = 0; i < vertices.size(); i++) m_total_force_cache[i] += faceForces[i];
+		const unsigned int end = m_multirate_faces.offsets[due + 1];
+		for (unsigned int k = 0; k < end; k++) {
+			const unsigned int i = m_multirate_faces.indices[k];
+			faceForce(i, f);
+			add(faces[i].x, f[0]);
+			add(faces[i].y, f[1]);
+			add(faces[i].z, f[2]);
+		}
+		constraint_evaluations += end;
 	}
-	if (enable_damping_force) {
-		std::vector<glm::vec3> dampingForces = this->dampingForce();
-		for (int i = 0; i < vertices.size(); i++) m_total_force_cache[i] += dampingForces[i];
+
+	// A vertex of level l takes a symplectic Euler step of 2^l deltaT: its velocity changes at the start, and
+	// its position follows that velocity over the whole step, deltaT at a time.
+	for (unsigned int v : starting) {
+		state.velocity[v] += state.force[v] * T(deltaT * float(1u << m_multirate_vertex_level[v]));
 	}
-	m_force_cache_used = true;
-	return m_total_force_cache;
+	// A vertex gets the force of a constraint for its own time step, so across levels the two ends of a
+	// constraint are not pushed equally and the sheet picks up some rigid motion, which nothing damps.
+	if (due > 0 && due == m_multirate_max_level) {
+		removeRigidMotion<T>();
+	}
+	const T dt = deltaT;
+	for (size_t i = 0; i < state.size(); i++) {
+		state.coords[i] += state.velocity[i] * dt;
+	}
+	if constexpr (!std::is_same_v<T, float>) {
+		storeDoubleVertices(0, state.size());
+	}
+	m_force_cache_used = false;
 }
 
-std::vector<glm::vec3> Origami::getVelocities()
+template<typename T>
+void Origami::stepActiveSet()
 {
-	std::vector<glm::vec3> ret;
-	for (int i = 0; i < vertices.size(); i++) {
-		ret.push_back(vertices[i].velocity);
+	VertexArrays<T>& state = vertexState<T>();
+	const size_t n = state.size();
+	const std::array<float, 8> parameters = { target_angle_percent, EA, k_fold, k_facet, k_face, damping_ratio,
+		float(enable_axial_constraints) + 2.0f * float(enable_crease_constraints) + 4.0f * float(enable_face_constraints),
+		float(enable_damping_force) };
+	if (m_awake.size() != n || parameters != m_active_set_parameters) {
+		m_awake.assign(n, 1);
+		m_sleep_counter.assign(n, 0);
+		m_active_vertices.resize(n);
+		std::iota(m_active_vertices.begin(), m_active_vertices.end(), 0u);
+		m_active_edges.clear();
+		m_active_creases.clear();
+		m_active_faces.clear();
+		m_active_vertex_marks.assign(n, 0);
+		m_active_edge_marks.assign(edges.size(), 0);
+		m_active_crease_marks.assign(creases.size(), 0);
+		m_active_face_marks.assign(faces.size(), 0);
+		m_active_set_parameters = parameters;
+		m_active_set_dirty = true;
 	}
-	return ret;
+	// While most constraints are active, the full force pass is faster than going through the lists. It knows
+	// the force of every vertex, so the lists are only rebuilt once enough vertices fell asleep that they might
+	// be worth it again. With the lists, a vertex that woke up needs its neighbours in them right away, while
+	// vertices falling asleep may stay in them for a while as sleeping neighbours.
+	auto fullPass = [this]() {
+		const size_t activeConstraints = m_active_edges.size() + m_active_creases.size() + m_active_faces.size();
+		return 2 * activeConstraints > edges.size() + creases.size() + faces.size();
+	};
+	bool full = fullPass();
+	const bool rebuild = full ? 4 * m_active_set_awake < 3 * m_active_set_awake_at_rebuild
+							  : m_active_set_dirty || m_active_set_sleepers * 16 > m_active_vertices.size();
+	if (rebuild) {
+		rebuildActiveSet();
+		full = fullPass();
+	}
+	updateEdgeConstants<T>();
+
+	if (full) {
+		computeTotalForce<T>();
+	} else {
+		// constraints around the evaluated vertices also touch vertices beyond them, which are left alone
+		auto add = [this, &state](unsigned int v, const Vec3<T>& f) {
+			if (m_active_vertex_marks[v]) {
+				state.force[v] += f;
+			}
+		};
+		const bool damping = dampingForceEnabled();
+		for (unsigned int v : m_active_vertices) {
+			state.force[v] = Vec3<T>(0);
+		}
+		if (enable_axial_constraints || damping) {
+			for (unsigned int i : m_active_edges) {
+				const Vec3<T> f = edgeForce<T>(i, enable_axial_constraints, damping);
+				add(edges[i].x, f);
+				add(edges[i].y, -f);
+			}
+			constraint_evaluations += m_active_edges.size();
+		}
+		Vec3<T> f[4];
+		if (enable_crease_constraints) {
+			for (unsigned int i : m_active_creases) {
+				const CreaseData& crease = creases[i];
+				creaseForce(crease, f);
+				add(crease.p1, f[0]);
+				add(crease.p2, f[1]);
+				add(crease.p3, f[2]);
+				add(crease.p4, f[3]);
+			}
+			constraint_evaluations += m_active_creases.size();
+		}
+		if (enable_face_constraints) {
+			for (unsigned int i : m_active_faces) {
+				faceForce(i, f);
+				add(faces[i].x, f[0]);
+				add(faces[i].y, f[1]);
+				add(faces[i].z, f[2]);
+			}
+			constraint_evaluations += m_active_faces.size();
+		}
+	}
+
+	// a vertex only wakes up at twice the force it may fall asleep with, so it does not keep flipping
+	const float sleepVelocitySq = active_set_velocity * active_set_velocity;
+	const float sleepForceSq = active_set_force * active_set_force;
+	const float wakeForceSq = 4.0f * sleepForceSq;
+	size_t awake = 0;
+	auto update = [&](unsigned int v) {
+		const float forceSq = float(glm::dot(state.force[v], state.force[v]));
+		if (m_awake[v]) {
+			state.velocity[v] += state.force[v] * T(deltaT);
+			state.coords[v] += state.velocity[v] * T(deltaT);
+			awake++;
+			if (forceSq < sleepForceSq && float(glm::dot(state.velocity[v], state.velocity[v])) < sleepVelocitySq) {
+				if (++m_sleep_counter[v] >= active_set_steps) {
+					m_awake[v] = 0;
+					state.velocity[v] = Vec3<T>(0);
+					m_active_set_sleepers++;
+				}
+			} else {
+				m_sleep_counter[v] = 0;
+			}
+		} else if (forceSq > wakeForceSq) {
+			m_awake[v] = 1;
+			m_sleep_counter[v] = 0;
+			m_active_set_dirty = true;
+			// the lists are rebuilt from the vertices in them, and the full pass can wake any vertex
+			if (!m_active_vertex_marks[v]) {
+				m_active_vertex_marks[v] = 1;
+				m_active_vertices.push_back(v);
+			}
+		}
+		if constexpr (!std::is_same_v<T, float>) {
+			storeDoubleVertices(v, v + 1);
+		}
+	};
+	if (full) {
+		// the full pass knows the exact force of every vertex, so any of them can wake up
+		for (unsigned int v = 0; v < n; v++) {
+			update(v);
+		}
+	} else {
+		for (unsigned int v : m_active_vertices) {
+			update(v);
+		}
+	}
+	m_active_set_awake = awake;
+	active_fraction = n > 0 ? float(awake) / float(n) : 0.0f;
+	m_force_cache_used = false;
 }
 
-std::vector<glm::vec3> Origami::getVertices()
+void Origami::rebuildActiveSet()
 {
-	std::vector<glm::vec3> verts;
-	for (int i = 0; i < vertices.size(); i++) {
-		verts.push_back(vertices[i].coords);
+	for (unsigned int v : m_active_vertices) {
+		m_active_vertex_marks[v] = 0;
+	}
+	for (unsigned int i : m_active_edges) {
+		m_active_edge_marks[i] = 0;
+	}
+	for (unsigned int i : m_active_creases) {
+		m_active_crease_marks[i] = 0;
+	}
+	for (unsigned int i : m_active_faces) {
+		m_active_face_marks[i] = 0;
+	}
+	std::vector<unsigned int> previous;
+	previous.swap(m_active_vertices);
+	m_active_edges.clear();
+	m_active_creases.clear();
+	m_active_faces.clear();
+
+	auto addVertex = [this](unsigned int v) {
+		if (!m_active_vertex_marks[v]) {
+			m_active_vertex_marks[v] = 1;
+			m_active_vertices.push_back(v);
+		}
+	};
+	for (unsigned int v : previous) {
+		if (m_awake[v]) {
+			addVertex(v);
+		}
 	}
-	return verts;
+	// the sleeping neighbours are evaluated as well, that is how they notice they have to wake up
+	const size_t awakeCount = m_active_vertices.size();
+	for (size_t k = 0; k < awakeCount; k++) {
+		const unsigned int v = m_active_vertices[k];
+		for (unsigned int i : vertex_to_edges.row(v)) {
+			addVertex(edges[i].x);
+			addVertex(edges[i].y);
+		}
+		for (unsigned int slot : vertex_to_creases.row(v)) {
+			const CreaseData& crease = creases[slot / 4];
+			addVertex(crease.p1);
+			addVertex(crease.p2);
+			addVertex(crease.p3);
+			addVertex(crease.p4);
+		}
+		for (unsigned int i : vertex_to_faces.row(v)) {
+			addVertex(faces[i].x);
+			addVertex(faces[i].y);
+			addVertex(faces[i].z);
+		}
+	}
+
+	// every evaluated vertex needs all of its constraints for its full force
+	for (unsigned int v : m_active_vertices) {
+		for (unsigned int i : vertex_to_edges.row(v)) {
+			if (!m_active_edge_marks[i]) {
+				m_active_edge_marks[i] = 1;
+				m_active_edges.push_back(i);
+			}
+		}
+		for (unsigned int slot : vertex_to_creases.row(v)) {
+			if (!m_active_crease_marks[slot / 4]) {
+				m_active_crease_marks[slot / 4] = 1;
+				m_active_creases.push_back(slot / 4);
+			}
+		}
+		for (unsigned int i : vertex_to_faces.row(v)) {
+			if (!m_active_face_marks[i]) {
+				m_active_face_marks[i] = 1;
+				m_active_faces.push_back(i);
+			}
+		}
+	}
+	// in memory order, which is also the order of the full force pass
+	std::sort(m_active_vertices.begin(), m_active_vertices.end());
+	std::sort(m_active_edges.begin(), m_active_edges.end());
+	std::sort(m_active_creases.begin(), m_active_creases.end());
+	std::sort(m_active_faces.begin(), m_active_faces.end());
+	m_active_set_dirty = false;
+	m_active_set_sleepers = 0;
+	m_active_set_awake = awakeCount;
+	m_active_set_awake_at_rebuild = awakeCount;
 }
 
-void Origami::setDefaultSettings()
+void Origami::stepImplicit()
 {
-	EA = 20.0f;
-	k_fold = 0.7f;
-	k_facet = 0.7f;
-	k_face = 0.2f;
-	damping_ratio = 0.45f;
-	enable_axial_constraints = true;
-	enable_crease_constraints = true;
-	enable_face_constraints = true;
-	enable_damping_force = true;
-	calculateOptimalTimeStep();
+	const float dt = deltaT * implicit_time_step_scale;
+	prepareImplicitSolver();
+	if (!m_force_cache_used) {
+		computeTotalForce();
+	}
+	// the cached forces may be older than a change of EA or damping_ratio, the assembly reads the constants directly
+	updateEdgeConstants();
+	assembleImplicitSystem(dt);
+
+	ThreadPool& pool = threadPool();
+	auto multiply = [this, &pool](std::span<const glm::vec3> in, std::span<glm::vec3> out) {
+		pool.parallelFor(in.size(), [this, in, out](size_t begin, size_t end) {
+			m_system.multiply(in, out, begin, end);
+		});
+	};
+	// block Jacobi
+	auto precondition = [this](std::span<const glm::vec3> in, std::span<glm::vec3> out) {
+		for (size_t i = 0; i < in.size(); i++) {
+			out[i] = m_system_diagonal_inverse[i] * in[i];
+		}
+	};
+	m_velocity_change.assign(vertices.size(), glm::vec3(0));
+	ConjugateGradientResult result = conjugateGradient(m_implicit_rhs, m_velocity_change, multiply, precondition, cg_tolerance, cg_max_iterations, m_cg_workspace);
+	last_cg_iterations = result.iterations;
+
+	// The internal forces sum to zero, so the exact solution does not change the total momentum. An inexact
+	// solve can, and nothing would ever damp that drift out again.
+	glm::dvec3 momentumChange(0.0);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		momentumChange += glm::dvec3(m_velocity_change[i]);
+	}
+	const glm::vec3 drift = glm::vec3(momentumChange / double(vertices.size()));
+
+	auto integrate = [this, dt, drift](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			vertices.velocity[i] += m_velocity_change[i] - drift;
+			vertices.coords[i] += vertices.velocity[i] * dt;
+		}
+	};
+	pool.parallelFor(vertices.size(), integrate);
+	m_force_cache_used = false;
 }
 
-void Origami::free() 
+void Origami::stepRelaxation()
 {
-	glDeleteVertexArrays(1, &m_vao_faces);
-	glDeleteBuffers(1, &m_vbo_faces);
-	glDeleteBuffers(1, &m_ibo_faces);
+	if (m_relaxation_mass.size() != vertices.size()) {
+		updateRelaxationMasses();
+		std::fill(vertices.velocity.begin(), vertices.velocity.end(), glm::vec3(0));
+		m_relaxation_restart = true;
+		m_kinetic_energy = 0.0;
+	}
+	if (!m_force_cache_used) {
+		computeTotalForce();
+	}
 
-	glDeleteVertexArrays(1, &m_vao_edges);
-	glDeleteBuffers(1, &m_vbo_edges);
-	glDeleteBuffers(1, &m_ibo_edges);
+	// The first step after a restart is half a step, because the velocities live in between the steps.
+	const float h = m_relaxation_restart ? 0.5f : 1.0f;
+	double kineticEnergy = 0.0;
+	float residual = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		const glm::vec3 v = vertices.velocity[i] + h * vertices.force[i] / m_relaxation_mass[i];
+		kineticEnergy += double(m_relaxation_mass[i] * glm::dot(v, v));
+		residual = std::max(residual, glm::length(vertices.force[i]));
+	}
+	last_residual = residual;
+	if (residual < relaxation_tolerance) {
+		// settled, but ready to move again if the fold percent changes
+		std::fill(vertices.velocity.begin(), vertices.velocity.end(), glm::vec3(0));
+		m_relaxation_restart = true;
+		m_kinetic_energy = 0.0;
+		return;
+	}
+
+	if (!m_relaxation_restart && kineticEnergy < m_kinetic_energy) {
+		// The kinetic energy peaked half a step ago, in the middle of the last step, so the vertices go back
+		// there and start again from rest.
+		for (size_t i = 0; i < vertices.size(); i++) {
+			vertices.coords[i] -= 0.5f * vertices.velocity[i];
+			vertices.velocity[i] = glm::vec3(0);
+		}
+		// the stiffness depends on the shape, so the masses are kept up to date at every restart
+		updateRelaxationMasses();
+		m_relaxation_restart = true;
+		m_kinetic_energy = 0.0;
+		m_force_cache_used = false;
+		return;
+	}
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		vertices.velocity[i] += h * vertices.force[i] / m_relaxation_mass[i];
+		vertices.coords[i] += vertices.velocity[i];
+	}
+	m_relaxation_restart = false;
+	m_kinetic_energy = kineticEnergy;
+	m_force_cache_used = false;
+}
+
+void Origami::updateRelaxationMasses()
+{
+	std::vector<float> stiffness(vertices.size(), 0.0f);
+	if (enable_axial_constraints) {
+		for (size_t i = 0; i < edges.size(); i++) {
+			const float k = EA / nominal_length[i];
+			stiffness[edges[i].x] += 2.0f * k;
+			stiffness[edges[i].y] += 2.0f * k;
+		}
+	}
+	if (enable_crease_constraints) {
+		glm::vec3 g[4];
+		for (const CreaseData& crease : creases) {
+			creaseAngleError(crease, g);
+			const float k = creaseStiffness(crease);
+			const float sum = glm::length(g[0]) + glm::length(g[1]) + glm::length(g[2]) + glm::length(g[3]);
+			stiffness[crease.p1] += k * glm::length(g[0]) * sum;
+			stiffness[crease.p2] += k * glm::length(g[1]) * sum;
+			stiffness[crease.p3] += k * glm::length(g[2]) * sum;
+			stiffness[crease.p4] += k * glm::length(g[3]) * sum;
+		}
+	}
+	if (enable_face_constraints) {
+		glm::vec3 g[3][3];
+		for (unsigned int i = 0; i < faces.size(); i++) {
+			faceAngleGradients(i, g);
+			const unsigned int corners[3] = { faces[i].x, faces[i].y, faces[i].z };
+			for (int c = 0; c < 3; c++) {
+				const float sum = glm::length(g[c][0]) + glm::length(g[c][1]) + glm::length(g[c][2]);
+				for (int p = 0; p < 3; p++) {
+					stiffness[corners[p]] += k_face * glm::length(g[c][p]) * sum;
+				}
+			}
+		}
+	}
+
+	m_relaxation_mass.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		// a vertex without any constraints still needs a mass
+		m_relaxation_mass[i] = relaxation_mass_scale * 0.5f * std::max(stiffness[i], 1e-6f);
+	}
+}
+
+void Origami::prepareImplicitSolver()
+{
+	if (m_system.rows() == vertices.size() && m_edge_slots.size() == edges.size()
+		&& m_crease_slots.size() == 16 * creases.size() && m_face_slots.size() == 9 * faces.size()) {
+		return;
+	}
+
+	std::vector<unsigned int> rows;
+	std::vector<unsigned int> columns;
+	auto addStencil = [&](const unsigned int* stencil, int size) {
+		for (int a = 0; a < size; a++) {
+			for (int b = 0; b < size; b++) {
+				rows.push_back(stencil[a]);
+				columns.push_back(stencil[b]);
+			}
+		}
+	};
+	for (const glm::uvec3& edge : edges) {
+		unsigned int stencil[2] = { edge.x, edge.y };
+		addStencil(stencil, 2);
+	}
+	for (const CreaseData& crease : creases) {
+		unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+		addStencil(stencil, 4);
+	}
+	for (const glm::uvec3& face : faces) {
+		unsigned int stencil[3] = { face.x, face.y, face.z };
+		addStencil(stencil, 3);
+	}
+	m_system.buildPattern(vertices.size(), rows, columns);
+
+	m_edge_slots.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		unsigned int x = edges[i].x;
+		unsigned int y = edges[i].y;
+		m_edge_slots[i] = glm::uvec4(m_system.slot(x, x), m_system.slot(x, y), m_system.slot(y, x), m_system.slot(y, y));
+	}
+	m_crease_slots.resize(16 * creases.size());
+	for (size_t i = 0; i < creases.size(); i++) {
+		unsigned int stencil[4] = { creases[i].p1, creases[i].p2, creases[i].p3, creases[i].p4 };
+		for (size_t a = 0; a < 4; a++) {
+			for (size_t b = 0; b < 4; b++) {
+				m_crease_slots[16 * i + 4 * a + b] = m_system.slot(stencil[a], stencil[b]);
+			}
+		}
+	}
+	m_face_slots.resize(9 * faces.size());
+	for (size_t i = 0; i < faces.size(); i++) {
+		unsigned int stencil[3] = { faces[i].x, faces[i].y, faces[i].z };
+		for (size_t a = 0; a < 3; a++) {
+			for (size_t b = 0; b < 3; b++) {
+				m_face_slots[9 * i + 3 * a + b] = m_system.slot(stencil[a], stencil[b]);
+			}
+		}
+	}
+}
+
+void Origami::assembleImplicitSystem(float dt)
+{
+	const float dt2 = dt * dt;
+	m_system.setZero();
+	for (size_t i = 0; i < vertices.size(); i++) {
+		m_system.blocks[m_system.diagonalSlot(static_cast<unsigned int>(i))] = glm::mat3(1.0f);
+	}
+
+	// dt^2 K v is gathered while assembling, so K itself is never stored. Every term of K is -k g g^T for a
+	// constraint with stiffness k and gradient g, so it adds +dt^2 k g g^T to the system.
+	std::vector<glm::vec3>& Kv = m_implicit_rhs;
+	Kv.assign(vertices.size(), glm::vec3(0));
+
+	if (enable_axial_constraints || enable_damping_force) {
+		for (size_t i = 0; i < edges.size(); i++) {
+			const unsigned int x = edges[i].x;
+			const unsigned int y = edges[i].y;
+			glm::mat3 block(0.0f);
+			if (enable_axial_constraints) {
+				const glm::vec3 n = glm::normalize(vertices.coords[x] - vertices.coords[y]);
+				const glm::mat3 stiffness = m_float_buffers.edge_constants.k_axial[i] * glm::outerProduct(n, n);
+				const glm::vec3 f = stiffness * (vertices.velocity[x] - vertices.velocity[y]);
+				Kv[x] -= f;
+				Kv[y] += f;
+				block += dt2 * stiffness;
+			}
+			if (enable_damping_force) {
+				block += dt * m_float_buffers.edge_constants.damping[i] * glm::mat3(1.0f);
+			}
+			const glm::uvec4& slots = m_edge_slots[i];
+			m_system.blocks[slots.x] += block;
+			m_system.blocks[slots.y] -= block;
+			m_system.blocks[slots.z] -= block;
+			m_system.blocks[slots.w] += block;
+		}
+	}
+
+	if (enable_crease_constraints) {
+		glm::vec3 gradient[4];
+		for (size_t i = 0; i < creases.size(); i++) {
+			const CreaseData& crease = creases[i];
+			creaseAngleError(crease, gradient);
+			const float k = creaseStiffness(crease);
+			const unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+			float gv = 0.0f;
+			for (int a = 0; a < 4; a++) {
+				gv += glm::dot(gradient[a], vertices.velocity[stencil[a]]);
+			}
+			for (size_t a = 0; a < 4; a++) {
+				Kv[stencil[a]] -= k * gv * gradient[a];
+				for (size_t b = 0; b < 4; b++) {
+					m_system.blocks[m_crease_slots[16 * i + 4 * a + b]] += dt2 * k * glm::outerProduct(gradient[a], gradient[b]);
+				}
+			}
+		}
+	}
+
+	if (enable_face_constraints) {
+		glm::vec3 gradients[3][3];
+		for (size_t i = 0; i < faces.size(); i++) {
+			faceAngleGradients(static_cast<unsigned int>(i), gradients);
+			const unsigned int stencil[3] = { faces[i].x, faces[i].y, faces[i].z };
+			for (int c = 0; c < 3; c++) {
+				float gv = 0.0f;
+				for (int a = 0; a < 3; a++) {
+					gv += glm::dot(gradients[c][a], vertices.velocity[stencil[a]]);
+				}
+				for (size_t a = 0; a < 3; a++) {
+					Kv[stencil[a]] -= k_face * gv * gradients[c][a];
+					for (size_t b = 0; b < 3; b++) {
+						m_system.blocks[m_face_slots[9 * i + 3 * a + b]] += dt2 * k_face * glm::outerProduct(gradients[c][a], gradients[c][b]);
+					}
+				}
+			}
+		}
+	}
+
+	// rhs = dt (f + dt K v), stored in the same array
+	for (size_t i = 0; i < vertices.size(); i++) {
+		m_implicit_rhs[i] = dt * (vertices.force[i] + dt * Kv[i]);
+	}
+
+	m_system_diagonal_inverse.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		m_system_diagonal_inverse[i] = glm::inverse(m_system.blocks[m_system.diagonalSlot(static_cast<unsigned int>(i))]);
+	}
+}
+
+/// <summary>
+/// Greedy coloring of constraints so that no two constraints of one color share a vertex. Row c of the result
+/// holds the constraints of color c in increasing order. vertexToSlots maps every vertex to
+/// slotsPerConstraint * i + k for every constraint i touching it, and stencil(i, vertices) writes the vertices of
+/// constraint i and returns how many there are.
+/// </summary>
+template<typename Stencil>
+static CsrTable colorConstraints(size_t count, const CsrTable& vertexToSlots, unsigned int slotsPerConstraint, Stencil&& stencil)
+{
+	const unsigned int uncolored = std::numeric_limits<unsigned int>::max();
+	std::vector<unsigned int> colors(count, uncolored);
+	// taken[c] == i + 1 if color c is already used by a neighbour of constraint i
+	std::vector<size_t> taken;
+	unsigned int vertices[4];
+	for (size_t i = 0; i < count; i++) {
+		const unsigned int size = stencil(i, vertices);
+		for (unsigned int a = 0; a < size; a++) {
+			for (unsigned int slot : vertexToSlots.row(vertices[a])) {
+				const unsigned int color = colors[slot / slotsPerConstraint];
+				if (color != uncolored) {
+					taken[color] = i + 1;
+				}
+			}
+		}
+		unsigned int color = 0;
+		while (color < taken.size() && taken[color] == i + 1) {
+			color++;
+		}
+		if (color == taken.size()) {
+			taken.push_back(0);
+		}
+		colors[i] = color;
+	}
+
+	std::vector<unsigned int> indices(count);
+	std::iota(indices.begin(), indices.end(), 0u);
+	CsrTable table;
+	table.build(taken.size(), colors, indices);
+	return table;
+}
+
+void Origami::prepareXpbd()
+{
+	if (m_edge_colors.indices.size() == edges.size() && m_crease_colors.indices.size() == creases.size()
+		&& m_face_colors.indices.size() == faces.size()) {
+		return;
+	}
+	m_edge_colors = colorConstraints(edges.size(), vertex_to_edges, 1, [this](size_t i, unsigned int* stencil) {
+		stencil[0] = edges[i].x;
+		stencil[1] = edges[i].y;
+		return 2u;
+	});
+	m_crease_colors = colorConstraints(creases.size(), vertex_to_creases, 4, [this](size_t i, unsigned int* stencil) {
+		stencil[0] = creases[i].p1;
+		stencil[1] = creases[i].p2;
+		stencil[2] = creases[i].p3;
+		stencil[3] = creases[i].p4;
+		return 4u;
+	});
+	m_face_colors = colorConstraints(faces.size(), vertex_to_faces, 1, [this](size_t i, unsigned int* stencil) {
+		stencil[0] = faces[i].x;
+		stencil[1] = faces[i].y;
+		stencil[2] = faces[i].z;
+		return 3u;
+	});
+}
+
+void Origami::stepXpbd()
+{
+	prepareXpbd();
+	updateEdgeConstants();
+	const int substeps = std::max(1, xpbd_substeps);
+	const float dt = deltaT * xpbd_time_step_scale / float(substeps);
+	const size_t n = vertices.size();
+
+	ThreadPool& pool = threadPool();
+	auto projectColors = [this, &pool](const CsrTable& colors, auto&& project) {
+		for (size_t c = 0; c < colors.rows(); c++) {
+			std::span<const unsigned int> constraints = colors.row(c);
+			if (num_threads > 1) {
+				pool.parallelFor(constraints.size(), [&](size_t begin, size_t end) {
+					for (size_t k = begin; k < end; k++) {
+						project(constraints[k]);
+					}
+				});
+			} else {
+				for (unsigned int i : constraints) {
+					project(i);
+				}
+			}
+		}
+	};
+
+	// every projection evaluates its constraint once, like a force evaluation of the other solvers
+	const size_t projections = (enable_axial_constraints ? edges.size() : 0) + (enable_crease_constraints ? creases.size() : 0)
+		+ (enable_face_constraints ? faces.size() : 0);
+	for (int substep = 0; substep < substeps; substep++) {
+		constraint_evaluations += uint64_t(std::max(0, xpbd_iterations)) * projections + (enable_damping_force ? edges.size() : 0);
+		// there are no external forces, so the prediction is just the current motion
+		m_previous_coords.assign(vertices.coords.begin(), vertices.coords.begin() + static_cast<std::ptrdiff_t>(n));
+		for (size_t i = 0; i < n; i++) {
+			vertices.coords[i] += dt * vertices.velocity[i];
+		}
+		m_xpbd_lambda.assign(edges.size() + creases.size() + 3 * faces.size(), 0.0f);
+
+		for (int iteration = 0; iteration < xpbd_iterations; iteration++) {
+			if (enable_axial_constraints) {
+				projectColors(m_edge_colors, [this, dt](unsigned int i) { projectAxialConstraint(i, dt); });
+			}
+			if (enable_crease_constraints) {
+				projectColors(m_crease_colors, [this, dt](unsigned int i) { projectCreaseConstraint(i, dt); });
+			}
+			if (enable_face_constraints) {
+				projectColors(m_face_colors, [this, dt](unsigned int i) { projectFaceConstraint(i, dt); });
+			}
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			vertices.velocity[i] = (vertices.coords[i] - m_previous_coords[i]) / dt;
+		}
+		removeRigidMotion();
+		// The damping force acts on the whole relative velocity of the endpoints and not just along the edge, so it
+		// is applied to the velocities afterwards instead of as constraint damping.
+		if (enable_damping_force) {
+			projectColors(m_edge_colors, [this, dt](unsigned int i) { dampEdgeVelocity(i, dt); });
+		}
+	}
+	m_force_cache_used = false;
+}
+
+template<typename T>
+void Origami::removeRigidMotion()
+{
+	VertexArrays<T>& state = vertexState<T>();
+	const size_t n = state.size();
+	glm::dvec3 center(0.0);
+	glm::dvec3 momentum(0.0);
+	for (size_t i = 0; i < n; i++) {
+		center += glm::dvec3(state.coords[i]);
+		momentum += glm::dvec3(state.velocity[i]);
+	}
+	center /= double(n);
+	const glm::dvec3 velocity = momentum / double(n);
+
+	glm::dvec3 angularMomentum(0.0);
+	glm::dmat3 inertia(0.0);
+	for (size_t i = 0; i < n; i++) {
+		const glm::dvec3 r = glm::dvec3(state.coords[i]) - center;
+		angularMomentum += glm::cross(r, glm::dvec3(state.velocity[i]) - velocity);
+		inertia += glm::dot(r, r) * glm::dmat3(1.0) - glm::outerProduct(r, r);
+	}
+	// a sheet that is still flat is singular around its normal, but has no angular momentum around it either
+	const double trace = inertia[0][0] + inertia[1][1] + inertia[2][2];
+	const glm::dvec3 omega = glm::inverse(inertia + 1e-9 * trace * glm::dmat3(1.0)) * angularMomentum;
+
+	for (size_t i = 0; i < n; i++) {
+		const glm::dvec3 r = glm::dvec3(state.coords[i]) - center;
+		state.velocity[i] -= Vec3<T>(velocity + glm::cross(omega, r));
+	}
+}
+
+void Origami::projectAxialConstraint(unsigned int i, float dt)
+{
+	const unsigned int x = edges[i].x;
+	const unsigned int y = edges[i].y;
+	const glm::vec3 d = vertices.coords[x] - vertices.coords[y];
+	const float length = glm::length(d);
+	if (length == 0.0f) {
+		return;
+	}
+	const glm::vec3 n = d / length;
+	const float error = length - nominal_length[i];
+	const float alpha = 1.0f / (m_float_buffers.edge_constants.k_axial[i] * dt * dt);
+	float& lambda = m_xpbd_lambda[i];
+	// both endpoints have unit mass and |dC/dx| = 1
+	const float deltaLambda = (-error - alpha * lambda) / (2.0f + alpha);
+	lambda += deltaLambda;
+	vertices.coords[x] += deltaLambda * n;
+	vertices.coords[y] -= deltaLambda * n;
+}
+
+void Origami::dampEdgeVelocity(unsigned int i, float dt)
+{
+	const unsigned int x = edges[i].x;
+	const unsigned int y = edges[i].y;
+	// backward Euler on the damping force c (v_y - v_x) of the other solvers, which shrinks the relative
+	// velocity by a factor 1 + 2 c dt
+	const float c = m_float_buffers.edge_constants.damping[i] * dt;
+	const glm::vec3 change = (c / (1.0f + 2.0f * c)) * (vertices.velocity[y] - vertices.velocity[x]);
+	vertices.velocity[x] += change;
+	vertices.velocity[y] -= change;
+}
+
+void Origami::projectCreaseConstraint(unsigned int i, float dt)
+{
+	const CreaseData& crease = creases[i];
+	const float k = creaseStiffness(crease);
+	if (k <= 0.0f) {
+		return;
+	}
+	glm::vec3 g[4];
+	const float error = creaseAngleError(crease, g);
+	const float weight = glm::dot(g[0], g[0]) + glm::dot(g[1], g[1]) + glm::dot(g[2], g[2]) + glm::dot(g[3], g[3]);
+	if (!std::isfinite(weight) || !std::isfinite(error)) {
+		// one of the faces is degenerate
+		return;
+	}
+	const float alpha = 1.0f / (k * dt * dt);
+	float& lambda = m_xpbd_lambda[edges.size() + i];
+	const float deltaLambda = (-error - alpha * lambda) / (weight + alpha);
+	lambda += deltaLambda;
+	vertices.coords[crease.p1] += deltaLambda * g[0];
+	vertices.coords[crease.p2] += deltaLambda * g[1];
+	vertices.coords[crease.p3] += deltaLambda * g[2];
+	vertices.coords[crease.p4] += deltaLambda * g[3];
+}
+
+void Origami::projectFaceConstraint(unsigned int i, float dt)
+{
+	if (k_face <= 0.0f) {
+		return;
+	}
+	const glm::uvec3& face = faces[i];
+	const float alpha = 1.0f / (k_face * dt * dt);
+	glm::vec3 g[3][3];
+	// the three angles share all their vertices, so each one sees the corrections of the ones before
+	for (int c = 0; c < 3; c++) {
+		faceAngleGradients(i, g);
+		const float error = angles(face)[c] - nominal_angles[i][c];
+		const float weight = glm::dot(g[c][0], g[c][0]) + glm::dot(g[c][1], g[c][1]) + glm::dot(g[c][2], g[c][2]);
+		if (!std::isfinite(weight) || !std::isfinite(error)) {
+			return;
+		}
+		float& lambda = m_xpbd_lambda[edges.size() + creases.size() + 3 * i + static_cast<size_t>(c)];
+		const float deltaLambda = (-error - alpha * lambda) / (weight + alpha);
+		lambda += deltaLambda;
+		vertices.coords[face.x] += deltaLambda * g[c][0];
+		vertices.coords[face.y] += deltaLambda * g[c][1];
+		vertices.coords[face.z] += deltaLambda * g[c][2];
+	}
+}
+
+void Origami::calculateOptimalTimeStep()
+{
+	// calculate optimal time step
+	float maxfreq = 0.0f;
+	for (int i = 0; i < edges.size(); i++) {
+
+		float k_axial = EA / nominal_length[i];
+		float freq = std::sqrt(k_axial);
+		if (freq > maxfreq) {
+			maxfreq = freq;
+		}
+	}
+
+	deltaT = 1.0f / (2.0f * M_PI * maxfreq);
+	if (spectral_time_step) {
+		deltaT = std::min(time_step_safety, SPECTRAL_TIME_STEP_MAX_SAFETY) * estimateCriticalTimeStep();
+		m_time_step_percent = target_angle_percent;
+		m_time_step_counter = 0;
+	}
+}
+
+void Origami::updateSpectralTimeStep()
+{
+	if (++m_time_step_counter < SPECTRAL_TIME_STEP_STEPS && std::abs(target_angle_percent - m_time_step_percent) < SPECTRAL_TIME_STEP_INTERVAL) {
+		return;
+	}
+	deltaT = std::min(time_step_safety, SPECTRAL_TIME_STEP_MAX_SAFETY) * estimateCriticalTimeStep();
+	m_time_step_percent = target_angle_percent;
+	m_time_step_counter = 0;
+}
+
+/// <summary>
+/// Largest eigenvalue of the symmetric positive semi-definite matrix applied by multiply, by power iteration.
+/// The Rayleigh quotient approaches it from below, so it is a slight underestimate.
+/// </summary>
+template<typename Multiply>
+static double largestEigenvalue(size_t n, Multiply&& multiply)
+{
+	const int maxIterations = 200;
+	const double tolerance = 1e-4;
+	std::vector<glm::vec3> x(n), y(n);
+	// a fixed start vector, so the result is the same on every run
+	uint32_t state = 12345u;
+	for (glm::vec3& v : x) {
+		for (int c = 0; c < 3; c++) {
+			state = state * 1664525u + 1013904223u;
+			v[c] = float(state >> 8) / float(1u << 24) - 0.5f;
+		}
+	}
+	double lambda = 0.0;
+	for (int iteration = 0; iteration < maxIterations; iteration++) {
+		const double norm = std::sqrt(dotProduct(x, x));
+		if (norm == 0.0) {
+			return 0.0;
+		}
+		for (glm::vec3& v : x) {
+			v *= float(1.0 / norm);
+		}
+		multiply(std::span<const glm::vec3>(x), std::span<glm::vec3>(y));
+		const double previous = lambda;
+		lambda = dotProduct(x, y);
+		std::swap(x, y);
+		if (iteration > 0 && std::abs(lambda - previous) <= tolerance * lambda) {
+			break;
+		}
+	}
+	return lambda;
+}
+
+float Origami::estimateCriticalTimeStep()
+{
+	const size_t n = vertices.size();
+	const double stiffness = largestEigenvalue(n, [&](std::span<const glm::vec3> in, std::span<glm::vec3> out) { multiplyStiffness(in, out); });
+	// the damping matrix does not depend on the shape
+	if (m_damping_eigenvalue < 0.0 || m_damping_eigenvalue_EA != EA || m_damping_eigenvalue_ratio != damping_ratio) {
+		m_damping_eigenvalue = largestEigenvalue(n, [&](std::span<const glm::vec3> in, std::span<glm::vec3> out) { multiplyDamping(in, out); });
+		m_damping_eigenvalue_EA = EA;
+		m_damping_eigenvalue_ratio = damping_ratio;
+	}
+	const double damping = enable_damping_force ? m_damping_eigenvalue : 0.0;
+	// A mode x'' = -k x - c x' is stable under symplectic Euler while k dt^2 + 2 c dt < 4. Taking the largest k and
+	// the largest c together is on the safe side, their modes are close to each other anyway.
+	if (stiffness <= 0.0) {
+		return damping > 0.0 ? float(2.0 / damping) : deltaT;
+	}
+	return float((std::sqrt(damping * damping + 4.0 * stiffness) - damping) / stiffness);
+}
+
+void Origami::multiplyStiffness(std::span<const glm::vec3> in, std::span<glm::vec3> out) const
+{
+	std::fill(out.begin(), out.end(), glm::vec3(0));
+
+	if (enable_axial_constraints) {
+		for (size_t i = 0; i < edges.size(); i++) {
+			const unsigned int x = edges[i].x;
+			const unsigned int y = edges[i].y;
+			const glm::vec3 n = glm::normalize(vertices.coords[x] - vertices.coords[y]);
+			const glm::vec3 f = (EA / nominal_length[i] * glm::dot(n, in[x] - in[y])) * n;
+			out[x] += f;
+			out[y] -= f;
+		}
+	}
+
+	if (enable_crease_constraints) {
+		glm::vec3 gradient[4];
+		for (const CreaseData& crease : creases) {
+			creaseAngleError(crease, gradient);
+			const unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+			float s = 0.0f;
+			for (int a = 0; a < 4; a++) {
+				s += glm::dot(gradient[a], in[stencil[a]]);
+			}
+			s *= creaseStiffness(crease);
+			for (int a = 0; a < 4; a++) {
+				out[stencil[a]] += s * gradient[a];
+			}
+		}
+	}
+
+	if (enable_face_constraints) {
+		glm::vec3 gradients[3][3];
+		for (size_t i = 0; i < faces.size(); i++) {
+			faceAngleGradients(static_cast<unsigned int>(i), gradients);
+			const unsigned int stencil[3] = { faces[i].x, faces[i].y, faces[i].z };
+			for (int c = 0; c < 3; c++) {
+				float s = 0.0f;
+				for (int a = 0; a < 3; a++) {
+					s += glm::dot(gradients[c][a], in[stencil[a]]);
+				}
+				s *= k_face;
+				for (int a = 0; a < 3; a++) {
+					out[stencil[a]] += s * gradients[c][a];
+				}
+			}
+		}
+	}
+}
+
+void Origami::multiplyDamping(std::span<const glm::vec3> in, std::span<glm::vec3> out) const
+{
+	std::fill(out.begin(), out.end(), glm::vec3(0));
+	for (size_t i = 0; i < edges.size(); i++) {
+		const unsigned int x = edges[i].x;
+		const unsigned int y = edges[i].y;
+		const glm::vec3 f = 2.0f * damping_ratio * std::sqrt(EA / nominal_length[i]) * (in[x] - in[y]);
+		out[x] += f;
+		out[y] -= f;
+	}
+}
+
+template<typename T>
+Vec3<T> Origami::axialForce(unsigned int i, T& stretch) const
+{
+	const std::vector<Vec3<T>>& coords = vertexState<T>().coords;
+	return ::axialForce(coords[edges[i].x], coords[edges[i].y], solverBuffers<T>().edge_constants.k_axial[i], restLengths<T>()[i], stretch);
+}
+
+float Origami::creaseStiffness(const CreaseData& crease) const
+{
+	return crease.nominal_length * (crease.type == FACET_EDGE ? k_facet : k_fold);
+}
+
+template<typename T>
+T Origami::creaseAngleError(const CreaseData& crease, Vec3<T> gradient[4]) const
+{
+	// full_target_angle is pi rounded to float, so the other types take their own
+	T fullTarget = crease.full_target_angle;
+	if constexpr (!std::is_same_v<T, float>) {
+		fullTarget = crease.type == FACET_EDGE ? T(0) : (crease.type == MOUNTAIN_EDGE ? -T(M_PI) : T(M_PI));
+	}
+	const T theta_target = fullTarget * T(target_angle_percent);
+	const std::vector<Vec3<T>>& coords = vertexState<T>().coords;
+	return ::creaseAngleError(coords[crease.p1], coords[crease.p2], coords[crease.p3], coords[crease.p4], T(crease.n1_sign), T(crease.n2_sign),
+		theta_target, gradient);
+}
+
+template<typename T>
+T Origami::creaseForce(const CreaseData& crease, Vec3<T> forces[4]) const
+{
+	Vec3<T> gradient[4];
+	const T error = creaseAngleError(crease, gradient);
+	const T magnitude = T(creaseStiffness(crease)) * error;
+	forces[0] = -magnitude * gradient[0];
+	forces[1] = -magnitude * gradient[1];
+	forces[2] = -magnitude * gradient[2];
+	forces[3] = -magnitude * gradient[3];
+	return error;
+}
+
+template<typename T>
+void Origami::faceAngleGradients(unsigned int i, Vec3<T> gradients[3][3]) const
+{
+	const std::vector<Vec3<T>>& coords = vertexState<T>().coords;
+	triangleAngleGradients(coords[faces[i].x], coords[faces[i].y], coords[faces[i].z], gradients);
+}
+
+template<typename T>
+Vec3<T> Origami::faceForce(unsigned int i, Vec3<T> forces[3]) const
+{
+	Vec3<T> gradients[3][3];
+	faceAngleGradients(i, gradients);
+	const std::vector<Vec3<T>>& coords = vertexState<T>().coords;
+	const Vec3<T> angleError = triangleAngles(coords[faces[i].x], coords[faces[i].y], coords[faces[i].z]) - restAngles<T>()[i];
+	const Vec3<T> error = T(k_face) * angleError;
+	for (int p = 0; p < 3; p++) {
+		forces[p] = -(error.x * gradients[0][p] + error.y * gradients[1][p] + error.z * gradients[2][p]);
+	}
+	return angleError;
+}
+
+template<typename T>
+Vec3<T> Origami::dampingForceOfEdge(unsigned int i) const
+{
+	const std::vector<Vec3<T>>& velocity = vertexState<T>().velocity;
+	return ::dampingForce(velocity[edges[i].x], velocity[edges[i].y], solverBuffers<T>().edge_constants.damping[i]);
+}
+
+template<typename T>
+Vec3<T> Origami::edgeForce(unsigned int i, bool axial, bool damping) const
+{
+	Vec3<T> force(0);
+	if (axial) {
+		T stretch;
+		force = axialForce(i, stretch);
+	}
+	if (damping) {
+		force += dampingForceOfEdge<T>(i);
+	}
+	return force;
+}
+
+template<typename T, bool Axial, bool Damping, bool Stats>
+void Origami::computeEdgeForcesImpl(size_t begin, size_t end, Vec3<T>* out, EdgeStats* stats) const
+{
+	const SolverBuffers<T>& buffers = solverBuffers<T>();
+	size_t i = begin;
+	if constexpr (std::is_same_v<T, float>) {
+		if (enable_simd && cpuSupportsAvx2()) {
+			i = edgeForcesAvx2(buffers.edge_constants, vertices.coords.data(), vertices.velocity.data(), Axial, Damping, begin, end, out,
+				Stats ? stats : nullptr);
+		}
+	}
+	for (; i < end; i++) {
+		// the same operations as edgeForce
+		Vec3<T> force(0);
+		T stretch = 0;
+		if constexpr (Axial) {
+			force = axialForce(static_cast<unsigned int>(i), stretch);
+		}
+		if constexpr (Damping) {
+			force += dampingForceOfEdge<T>(static_cast<unsigned int>(i));
+		}
+		out[i - begin] = force;
+		if constexpr (Stats) {
+			stats->energy += double(T(0.5) * buffers.edge_constants.k_axial[i] * stretch * stretch);
+			stats->max_strain = std::max(stats->max_strain, float(std::abs(stretch) / restLengths<T>()[i]));
+		}
+	}
+}
+
+template<typename T>
+void Origami::computeEdgeForces(size_t begin, size_t end, bool axial, bool damping, Vec3<T>* out, EdgeStats* stats) const
+{
+	if (axial && damping) {
+		if (stats) {
+			computeEdgeForcesImpl<T, true, true, true>(begin, end, out, stats);
+		} else {
+			computeEdgeForcesImpl<T, true, true, false>(begin, end, out, stats);
+		}
+	} else if (axial) {
+		if (stats) {
+			computeEdgeForcesImpl<T, true, false, true>(begin, end, out, stats);
+		} else {
+			computeEdgeForcesImpl<T, true, false, false>(begin, end, out, stats);
+		}
+	} else if (damping) {
+		computeEdgeForcesImpl<T, false, true, false>(begin, end, out, stats);
+	} else {
+		std::fill(out, out + (end - begin), Vec3<T>(0));
+	}
+}
+
+template<typename T, bool Stats, typename Sink>
+void Origami::creaseForces(size_t begin, size_t end, ConstraintStats& stats, Sink&& sink) const
+{
+	const size_t split = std::clamp(facet_crease_count, begin, end);
+	Vec3<T> gradient[4];
+	Vec3<T> f[4];
+	for (size_t range = 0; range < 2; range++) {
+		const T k = range == 0 ? k_facet : k_fold;
+		for (size_t i = range == 0 ? begin : split; i < (range == 0 ? split : end); i++) {
+			// the same operations as creaseForce, with creaseStiffness known for the whole range
+			const CreaseData& crease = creases[i];
+			const T error = creaseAngleError(crease, gradient);
+			const T stiffness = T(crease.nominal_length) * k;
+			const T magnitude = stiffness * error;
+			f[0] = -magnitude * gradient[0];
+			f[1] = -magnitude * gradient[1];
+			f[2] = -magnitude * gradient[2];
+			f[3] = -magnitude * gradient[3];
+			sink(i, f);
+			if constexpr (Stats) {
+				stats.crease_energy += double(T(0.5) * stiffness * error * error);
+				stats.max_crease_error = std::max(stats.max_crease_error, float(std::abs(error)));
+			}
+		}
+	}
+}
+
+template<typename T, bool Stats, typename Sink>
+void Origami::faceForces(size_t begin, size_t end, ConstraintStats& stats, Sink&& sink) const
+{
+	Vec3<T> f[3];
+	for (size_t i = begin; i < end; i++) {
+		const Vec3<T> error = faceForce(static_cast<unsigned int>(i), f);
+		sink(i, f);
+		if constexpr (Stats) {
+			const Vec3<T> absError = glm::abs(error);
+			stats.face_energy += double(T(0.5) * T(k_face) * glm::dot(error, error));
+			stats.max_face_error = std::max(stats.max_face_error, float(std::max(absError.x, std::max(absError.y, absError.z))));
+		}
+	}
+}
+
+template<typename T>
+void Origami::updateEdgeConstants()
+{
+	EdgeConstants<T>& constants = solverBuffers<T>().edge_constants;
+	if (constants.size() == edges.size() && constants.EA == EA && constants.damping_ratio == damping_ratio) {
+		return;
+	}
+	const std::vector<T>& lengths = restLengths<T>();
+	constants.v1.resize(edges.size());
+	constants.v2.resize(edges.size());
+	constants.nominal_length.resize(edges.size());
+	constants.k_axial.resize(edges.size());
+	constants.damping.resize(edges.size());
+	for (size_t i = 0; i < edges.size(); i++) {
+		constants.v1[i] = static_cast<int>(edges[i].x);
+		constants.v2[i] = static_cast<int>(edges[i].y);
+		constants.nominal_length[i] = lengths[i];
+		constants.k_axial[i] = T(EA) / lengths[i];
+		constants.damping[i] = 2 * T(damping_ratio) * std::sqrt(T(EA) / lengths[i]);
+	}
+	constants.EA = EA;
+	constants.damping_ratio = damping_ratio;
+}
+
+template<typename T>
+void Origami::addEdgeForces(std::vector<Vec3<T>>& forces, bool axial, bool damping, ConstraintStats* stats)
+{
+	// small blocks so the forces are still in the cache when they are scattered
+	const size_t blockSize = 256;
+	Vec3<T> block[blockSize];
+	EdgeStats edgeStats;
+	for (size_t begin = 0; begin < edges.size(); begin += blockSize) {
+		size_t end = std::min(begin + blockSize, edges.size());
+		computeEdgeForces(begin, end, axial, damping, block, stats ? &edgeStats : nullptr);
+		for (size_t i = begin; i < end; i++) {
+			forces[edges[i].x] += block[i - begin];
+			forces[edges[i].y] -= block[i - begin];
+		}
+	}
+	if (stats) {
+		stats->axial_energy += edgeStats.energy;
+		stats->max_strain = std::max(stats->max_strain, edgeStats.max_strain);
+	}
+}
+
+template<typename T>
+void Origami::addCreaseForces(std::vector<Vec3<T>>& forces, ConstraintStats* stats)
+{
+	auto add = [&forces, this](size_t i, const Vec3<T> f[4]) {
+		const CreaseData& crease = creases[i];
+		forces[crease.p1] += f[0];
+		forces[crease.p2] += f[1];
+		forces[crease.p3] += f[2];
+		forces[crease.p4] += f[3];
+	};
+	if (stats) {
+		creaseForces<T, true>(0, creases.size(), *stats, add);
+	} else {
+		ConstraintStats unused;
+		creaseForces<T, false>(0, creases.size(), unused, add);
+	}
+}
+
+template<typename T>
+void Origami::addFaceForces(std::vector<Vec3<T>>& forces, ConstraintStats* stats)
+{
+	auto add = [&forces, this](size_t i, const Vec3<T> f[3]) {
+		forces[faces[i].x] += f[0];
+		forces[faces[i].y] += f[1];
+		forces[faces[i].z] += f[2];
+	};
+	if (stats) {
+		faceForces<T, true>(0, faces.size(), *stats, add);
+	} else {
+		ConstraintStats unused;
+		faceForces<T, false>(0, faces.size(), unused, add);
+	}
+}
+
+std::vector<glm::vec3> Origami::axialConstraints()
+{
+	updateEdgeConstants();
+	std::vector<glm::vec3> forces(vertices.size(), glm::vec3(0));
+	addEdgeForces(forces, true, false);
+	return forces;
+}
+
+std::vector<glm::vec3> Origami::creaseConstraints()
+{
+	std::vector<glm::vec3> forces(vertices.size(), glm::vec3(0));
+	addCreaseForces(forces);
+	return forces;
+}
+
+std::vector<glm::vec3> Origami::faceConstraints()
+{
+	std::vector<glm::vec3> forces(vertices.size(), glm::vec3(0));
+	addFaceForces(forces);
+	return forces;
+}
+
+std::vector<glm::vec3> Origami::dampingForce()
+{
+	updateEdgeConstants();
+	std::vector<glm::vec3> forces(vertices.size(), glm::vec3(0));
+	addEdgeForces(forces, false, true);
+	return forces;
+}
+
+template<typename T>
+void Origami::computeTotalForce()
+{
+	VertexArrays<T>& state = vertexState<T>();
+	updateEdgeConstants<T>();
+	constraint_evaluations += (enable_axial_constraints || dampingForceEnabled() ? edges.size() : 0)
+		+ (enable_crease_constraints ? creases.size() : 0) + (enable_face_constraints ? faces.size() : 0);
+	if (num_threads > 1) {
+		computeTotalForceParallel<T>();
+	} else {
+		std::fill(state.force.begin(), state.force.end(), Vec3<T>(0));
+		const bool damping = dampingForceEnabled();
+		ConstraintStats stats;
+		ConstraintStats* gather = gather_constraint_stats ? &stats : nullptr;
+		if (enable_axial_constraints || damping) {
+			addEdgeForces(state.force, enable_axial_constraints, damping, gather);
+		}
+		if (enable_crease_constraints) {
+			addCreaseForces(state.force, gather);
+		}
+		if (enable_face_constraints) {
+			addFaceForces(state.force, gather);
+		}
+		if (gather) {
+			stats.steps = convergence.steps;
+			constraint_stats = stats;
+		}
+	}
+	if constexpr (!std::is_same_v<T, float>) {
+		storeDoubleVertices(0, state.size());
+	}
+	m_force_cache_used = true;
+	m_force_cache_double = !std::is_same_v<T, float>;
+}
+
+template<typename T>
+void Origami::computeTotalForceParallel()
+{
+	ThreadPool& pool = threadPool();
+	VertexArrays<T>& state = vertexState<T>();
+	SolverBuffers<T>& buffers = solverBuffers<T>();
+	const bool damping = dampingForceEnabled();
+	const bool edgeForces = enable_axial_constraints || damping;
+	buffers.edge_forces.resize(edges.size());
+	buffers.crease_forces.resize(4 * creases.size());
+	buffers.face_forces.resize(3 * faces.size());
+	const bool gather = gather_constraint_stats;
+	m_chunk_stats.assign(gather ? pool.size() : 0, ConstraintStats());
+
+	// First every constraint writes its forces into its own slots, so no two threads write to the same place.
+	// The same goes for the stats, every thread keeps its own and they are summed in a fixed order at the end.
+	if (edgeForces) {
+		pool.parallelForChunks(edges.size(), [this, &buffers, damping, gather](unsigned int chunk, size_t begin, size_t end) {
+			EdgeStats edgeStats;
+			computeEdgeForces(begin, end, enable_axial_constraints, damping, &buffers.edge_forces[begin], gather ? &edgeStats : nullptr);
+			if (gather) {
+				m_chunk_stats[chunk].axial_energy = edgeStats.energy;
+				m_chunk_stats[chunk].max_strain = edgeStats.max_strain;
+			}
+		});
+	}
+	if (enable_crease_constraints) {
+		pool.parallelForChunks(creases.size(), [this, &buffers, gather](unsigned int chunk, size_t begin, size_t end) {
+			auto store = [&buffers](size_t i, const Vec3<T> f[4]) {
+				std::copy(f, f + 4, &buffers.crease_forces[4 * i]);
+			};
+			ConstraintStats stats;
+			if (gather) {
+				creaseForces<T, true>(begin, end, stats, store);
+				m_chunk_stats[chunk].crease_energy = stats.crease_energy;
+				m_chunk_stats[chunk].max_crease_error = stats.max_crease_error;
+			} else {
+				creaseForces<T, false>(begin, end, stats, store);
+			}
+		});
+	}
+	if (enable_face_constraints) {
+		pool.parallelForChunks(faces.size(), [this, &buffers, gather](unsigned int chunk, size_t begin, size_t end) {
+			auto store = [&buffers](size_t i, const Vec3<T> f[3]) {
+				std::copy(f, f + 3, &buffers.face_forces[3 * i]);
+			};
+			ConstraintStats stats;
+			if (gather) {
+				faceForces<T, true>(begin, end, stats, store);
+				m_chunk_stats[chunk].face_energy = stats.face_energy;
+				m_chunk_stats[chunk].max_face_error = stats.max_face_error;
+			} else {
+				faceForces<T, false>(begin, end, stats, store);
+			}
+		});
+	}
+	if (gather) {
+		ConstraintStats stats;
+		for (const ConstraintStats& chunkStats : m_chunk_stats) {
+			stats.add(chunkStats);
+		}
+		stats.steps = convergence.steps;
+		constraint_stats = stats;
+	}
+
+	// Then every vertex sums the slots of the constraints around it. The adjacency tables are sorted, so the
+	// sums are done in exactly the same order as the serial add*Forces loops and the result is bit-identical.
+	pool.parallelFor(state.size(), [this, &state, &buffers, edgeForces](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; v++) {
+			Vec3<T> force(0);
+			if (edgeForces) {
+				for (unsigned int e : vertex_to_edges.row(v)) {
+					if (edges[e].x == v) {
+						force += buffers.edge_forces[e];
+					} else {
+						force -= buffers.edge_forces[e];
+					}
+				}
+			}
+			if (enable_crease_constraints) {
+				for (unsigned int slot : vertex_to_creases.row(v)) {
+					force += buffers.crease_forces[slot];
+				}
+			}
+			if (enable_face_constraints) {
+				for (unsigned int f : vertex_to_faces.row(v)) {
+					unsigned int corner = faces[f].x == v ? 0 : (faces[f].y == v ? 1 : 2);
+					force += buffers.face_forces[3 * f + corner];
+				}
+			}
+			state.force[v] = force;
+		}
+	});
+}
+
+bool Origami::dampingForceEnabled() const
+{
+	// dynamic relaxation damps by stopping the vertices instead
+	return enable_damping_force && solver != SOLVER_RELAXATION;
+}
+
+ThreadPool& Origami::threadPool()
+{
+	const unsigned int threads = static_cast<unsigned int>(std::max(num_threads, 1));
+	if (!m_thread_pool || m_thread_pool->size() != threads) {
+		m_thread_pool = std::make_shared<ThreadPool>(threads);
+	}
+	return *m_thread_pool;
+}
+
+std::span<const glm::vec3> Origami::getTotalForce()
+{
+	if (!m_force_cache_used) {
+		if (doublePrecisionActive()) {
+			loadDoubleVertices();
+			computeTotalForce<double>();
+		} else {
+			computeTotalForce();
+		}
+	}
+	return std::span<const glm::vec3>(vertices.force.data(), vertices.size());
+}
+
+const ConstraintStats& Origami::computeConstraintStats()
+{
+	const bool gather = gather_constraint_stats;
+	const uint64_t evaluations = constraint_evaluations;
+	gather_constraint_stats = true;
+	computeTotalForce();
+	gather_constraint_stats = gather;
+	constraint_evaluations = evaluations;
+	return constraint_stats;
+}
+
+bool Origami::doublePrecisionActive() const
+{
+	return double_precision && solver == SOLVER_EXPLICIT;
+}
+
+std::span<const glm::vec3> Origami::getVelocities()
+{
+	return std::span<const glm::vec3>(vertices.velocity.data(), vertices.size());
+}
+
+float Origami::maxVelocity()
+{
+	float maxVel = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		maxVel = std::max(maxVel, glm::length(vertices.velocity[i]));
+	}
+	return maxVel;
+}
+
+float Origami::maxAxialStrain() const
+{
+	float largest = 0.0f;
+	for (size_t i = 0; i < edges.size(); i++) {
+		const float length = glm::length(vertices.coords[edges[i].x] - vertices.coords[edges[i].y]);
+		largest = std::max(largest, std::abs(length - nominal_length[i]) / nominal_length[i]);
+	}
+	return largest;
+}
+
+float Origami::maxFaceAngleError() const
+{
+	float largest = 0.0f;
+	for (size_t i = 0; i < faces.size(); i++) {
+		const glm::vec3 error = glm::abs(angles(faces[i]) - nominal_angles[i]);
+		largest = std::max(largest, std::max(error.x, std::max(error.y, error.z)));
+	}
+	return largest;
+}
+
+std::span<const glm::vec3> Origami::getVertices()
+{
+	return std::span<const glm::vec3>(vertices.coords.data(), vertices.size());
+}
+
+void Origami::setDefaultSettings()
+{
+	EA = 20.0f;
+	k_fold = 0.7f;
+	k_facet = 0.7f;
+	k_face = 0.2f;
+	damping_ratio = 0.45f;
+	enable_axial_constraints = true;
+	enable_crease_constraints = true;
+	enable_face_constraints = true;
+	enable_damping_force = true;
+	calculateOptimalTimeStep();
 }
 
 bool Origami::intersectWithFace(Ray& ray, unsigned int face)
 {
-	glm::vec3 A = vertices[faces[face].x].coords;
-	glm::vec3 B = vertices[faces[face].y].coords;
-	glm::vec3 C = vertices[faces[face].z].coords;
+	glm::vec3 A = vertices.coords[faces[face].x];
+	glm::vec3 B = vertices.coords[faces[face].y];
+	glm::vec3 C = vertices.coords[faces[face].z];
 	glm::vec3 n = glm::cross(B - A, C - A);
 	n = glm::normalize(n);
 	
@@ -645,7 +2269,7 @@ bool Origami::intersectWithFace(Ray& ray, unsigned int face)
 		return false;
 	}
 
-	float t = (glm::dot(n, vertices[faces[face].x].coords) - glm::dot(n, ray.origin)) / glm::dot(n, ray.direction);
+	float t = (glm::dot(n, vertices.coords[faces[face].x]) - glm::dot(n, ray.origin)) / glm::dot(n, ray.direction);
 
 	if (ray.t <= t) {
 		return false;
@@ -673,11 +2297,11 @@ bool Origami::intersectWithRay(Ray& ray)
 	if (ret) {
 		ray.face = bestFace;
 		glm::vec3 p = ray.origin + ray.t * ray.direction;
-		float totalArea = areaOfTriangle(vertices[faces[bestFace].x].coords, vertices[faces[bestFace].y].coords, vertices[faces[bestFace].z].coords);
+		float totalArea = areaOfTriangle(vertices.coords[faces[bestFace].x], vertices.coords[faces[bestFace].y], vertices.coords[faces[bestFace].z]);
 		ray.barycentricCoords = glm::vec3(
-			areaOfTriangle(p, vertices[faces[bestFace].y].coords, vertices[faces[bestFace].z].coords),
-			areaOfTriangle(vertices[faces[bestFace].x].coords, p, vertices[faces[bestFace].z].coords),
-			areaOfTriangle(vertices[faces[bestFace].x].coords, vertices[faces[bestFace].y].coords, p)
+			areaOfTriangle(p, vertices.coords[faces[bestFace].y], vertices.coords[faces[bestFace].z]),
+			areaOfTriangle(vertices.coords[faces[bestFace].x], p, vertices.coords[faces[bestFace].z]),
+			areaOfTriangle(vertices.coords[faces[bestFace].x], vertices.coords[faces[bestFace].y], p)
 		) / totalArea;
 	}
 	return ret;
@@ -689,8 +2313,8 @@ glm::vec3 Origami::getSelectedPoint(Settings& settings)
 		return glm::vec3(0);
 	} else {
 		return 
-			settings.selectedPointBarycentricCoords.x * vertices[faces[settings.selectedPointFace].x].coords +
-			settings.selectedPointBarycentricCoords.y * vertices[faces[settings.selectedPointFace].y].coords +
-			settings.selectedPointBarycentricCoords.z * vertices[faces[settings.selectedPointFace].z].coords;
+			settings.selectedPointBarycentricCoords.x * vertices.coords[faces[settings.selectedPointFace].x] +
+			settings.selectedPointBarycentricCoords.y * vertices.coords[faces[settings.selectedPointFace].y] +
+			settings.selectedPointBarycentricCoords.z * vertices.coords[faces[settings.selectedPointFace].z];
 	}
 }
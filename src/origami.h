@@ -1,11 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <glm/ext/vector_float3.hpp>
 #include <glm/ext/vector_int3.hpp>
-#include <framework/shader.h>
+#include <glm/glm.hpp>
 #include <framework/ray.h>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include "settings.h"
+#include "csr_table.h"
+#include "constraint_kernels.h"
+#include "edge_kernels.h"
+#include "block_sparse_matrix.h"
+#include "conjugate_gradient.h"
+#include "thread_pool.h"
 //#include <glm/fwd.hpp>
 
 #define BOUNDARY_EDGE 0u
@@ -17,37 +31,160 @@
 #define RENDERMODE_VELOCITY 1
 #define RENDERMODE_FORCE 2
 
+#define SOLVER_EXPLICIT 0
+#define SOLVER_IMPLICIT 1
+#define SOLVER_RELAXATION 2
+#define SOLVER_XPBD 3
+
+#define FOLD_RAMP_INTERVAL 10
+#define SPECTRAL_TIME_STEP_INTERVAL 0.05f
+#define SPECTRAL_TIME_STEP_STEPS 500
+#define SPECTRAL_TIME_STEP_MAX_SAFETY 0.9f
+#define WATCHDOG_MIN_ENERGY 1e-9
+
+/// <summary>
+/// State of the simulation after the last step, see Origami::convergence.
+/// </summary>
+struct ConvergenceStats {
+	/// <summary>
+	/// Sum of |v|^2 / 2 over all vertices (they all have unit mass), largest velocity magnitude and largest net
+	/// constraint force on a vertex. The forces are those the last step started from; the XPBD solver does not
+	/// need them and only computes them if Origami::convergence_force is set, otherwise max_force is 0.
+	/// </summary>
+	double kinetic_energy = 0.0;
+	float max_velocity = 0.0f;
+	float max_force = 0.0f;
+	/// <summary>
+	/// Steps since the origami was loaded, and how many of the last ones in a row met the criterion.
+	/// </summary>
+	int steps = 0;
+	int settled_steps = 0;
+	bool converged = false;
+	/// <summary>
+	/// Set once a velocity or force is no longer finite. A diverged simulation never counts as converged.
+	/// </summary>
+	bool diverged = false;
+};
+
+/// <summary>
+/// Energies and largest residuals of the constraints, see Origami::gather_constraint_stats. A constraint type
+/// that is turned off contributes nothing.
+/// </summary>
+struct ConstraintStats {
+	/// <summary>
+	/// Sum of k e^2 / 2 over the axial, crease and face constraints, with e the residual of the constraint.
+	/// The damping force is not part of any energy.
+	/// </summary>
+	double axial_energy = 0.0;
+	double crease_energy = 0.0;
+	double face_energy = 0.0;
+	/// <summary>
+	/// Largest axial strain |l - L| / L, largest difference between the angle of a crease and its target, and
+	/// largest difference between a face angle and its angle in the flat pattern. Angles are in radians.
+	/// </summary>
+	float max_strain = 0.0f;
+	float max_crease_error = 0.0f;
+	float max_face_error = 0.0f;
+	/// <summary>
+	/// ConvergenceStats::steps at the time they were gathered, -1 before the first time.
+	/// </summary>
+	int steps = -1;
+
+	double energy() const {
+		return axial_energy + crease_energy + face_energy;
+	}
+
+	void add(const ConstraintStats& other) {
+		axial_energy += other.axial_energy;
+		crease_energy += other.crease_energy;
+		face_energy += other.face_energy;
+		max_strain = std::max(max_strain, other.max_strain);
+		max_crease_error = std::max(max_crease_error, other.max_crease_error);
+		max_face_error = std::max(max_face_error, other.max_face_error);
+	}
+};
+
 class Origami {
 public:
 	Origami();
 
 	static Origami loadFromFile(std::filesystem::path filePath);
 
+	/// <summary>
+	/// Writes the current state of the origami as a .fold file. The faces are written triangulated.
+	/// </summary>
+	void saveToFile(std::filesystem::path filePath);
+
 	/// <summary>
 	/// Trianglulates the origami by turning all 
 	/// </summary>
 	void triangulate(std::vector<unsigned int> verts);
 
-	//void draw(const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, int renderMode, float magnitudeCutoff);
-	void draw(const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, Settings& settings);
-
-	void updateVertexBuffers();
-
+	/// <summary>
+	/// Advances the simulation by one step of the selected solver.
+	/// </summary>
 	void step();
+	/// <summary>
+	/// Sets deltaT, from the stiffest edge or with spectral_time_step from estimateCriticalTimeStep.
+	/// </summary>
 	void calculateOptimalTimeStep();
+	/// <summary>
+	/// With spectral_time_step, sets deltaT from a new estimate at the current shape every SPECTRAL_TIME_STEP_STEPS
+	/// steps, or sooner once the fold percent moved by SPECTRAL_TIME_STEP_INTERVAL since the last estimate.
+	/// </summary>
+	void updateSpectralTimeStep();
+	/// <summary>
+	/// Largest time step for which the explicit solver is stable at the current positions: with lambda_K and
+	/// lambda_D the largest eigenvalues of the stiffness and damping matrices, the dt at which
+	/// lambda_K dt^2 + 2 lambda_D dt = 4. Both are found by power iteration over the constraints, so this takes
+	/// the creases, the faces and the number of edges at every vertex into account.
+	/// </summary>
+	float estimateCriticalTimeStep();
 
+	/// <summary>
+	/// The forces of a single constraint type on every vertex. These allocate a new array on every call and are
+	/// only meant for visualising the individual terms, the simulation itself uses getTotalForce.
+	/// </summary>
 	std::vector<glm::vec3> axialConstraints();
 	std::vector<glm::vec3> creaseConstraints();
 	std::vector<glm::vec3> faceConstraints();
 	std::vector<glm::vec3> dampingForce();
 
-	std::vector<glm::vec3> getTotalForce();
-	std::vector<glm::vec3> getVelocities();
+	/// <summary>
+	/// Sum of the forces of all enabled constraints at the current positions. The returned view points into the
+	/// solver's own force buffer and stays valid until the next step.
+	/// </summary>
+	std::span<const glm::vec3> getTotalForce();
+	/// <summary>
+	/// Recomputes the forces at the current positions and gathers constraint_stats from them, whether or not
+	/// gather_constraint_stats is set. Does not count towards constraint_evaluations.
+	/// </summary>
+	const ConstraintStats& computeConstraintStats();
+	/// <summary>
+	/// Whether step() runs in double precision, i.e. double_precision is set and the explicit solver is used.
+	/// </summary>
+	bool doublePrecisionActive() const;
+	std::span<const glm::vec3> getVelocities();
+
+	std::span<const glm::vec3> getVertices();
 
-	std::vector<glm::vec3> getVertices();
+	/// <summary>
+	/// Largest velocity magnitude over all vertices.
+	/// </summary>
+	float maxVelocity();
+	/// <summary>
+	/// Largest |l - L| / L over all edges, and the largest difference between an angle of a face and its angle
+	/// in the flat pattern, in radians. These are the residuals of the axial and face constraints.
+	/// </summary>
+	float maxAxialStrain() const;
+	float maxFaceAngleError() const;
+	/// <summary>
+	/// Starts counting the steps that meet the convergence criterion from zero again, for when something
+	/// changed that the criterion cannot see, like the fold percent. Also forgets the forces computed so far.
+	/// </summary>
+	void resetConvergence();
 
 	void setDefaultSettings();
-	void free();
 
 	bool intersectWithRay(Ray& ray);
 
@@ -60,6 +197,14 @@ public:
 	float k_face = 0.2f;
 	float damping_ratio = 0.45f;
 	float deltaT = 0.01; // recalculated when loading an origami
+	/// <summary>
+	/// Let calculateOptimalTimeStep set deltaT to time_step_safety times estimateCriticalTimeStep instead of
+	/// 1 / (2 pi sqrt(k)) for the stiffest edge. The safety is capped at SPECTRAL_TIME_STEP_MAX_SAFETY, power
+	/// iteration underestimates the largest eigenvalue. The estimate only holds for the current shape, so step()
+	/// estimates again as it folds, see updateSpectralTimeStep. A watchdog rollback halves time_step_safety.
+	/// </summary>
+	bool spectral_time_step = false;
+	float time_step_safety = 0.85f;
 	float target_angle_percent = 0.0;
 
 	bool enable_axial_constraints = true;
@@ -67,11 +212,177 @@ public:
 	bool enable_face_constraints = true;
 	bool enable_damping_force = true;
 
+	/// <summary>
+	/// Number of threads used for a step. With more than one thread the results are still bit-identical
+	/// to the single-threaded ones.
+	/// </summary>
+	int num_threads = 1;
+
+	/// <summary>
+	/// Use the AVX2 versions of the axial and damping kernels when the CPU supports them. Only useful for
+	/// comparing, the results are identical either way.
+	/// </summary>
+	bool enable_simd = true;
+
+	/// <summary>
+	/// SOLVER_EXPLICIT, SOLVER_IMPLICIT, SOLVER_RELAXATION or SOLVER_XPBD
+	/// </summary>
+	int solver = SOLVER_EXPLICIT;
+	/// <summary>
+	/// Lets the explicit solver pick its own time step. The error of every step is estimated by comparing it to
+	/// a velocity Verlet step, and steps with an error above adaptive_tolerance are rolled back and retried with
+	/// a smaller time step. The time step grows again while the error stays small, up to
+	/// adaptive_max_time_step_scale times deltaT.
+	/// </summary>
+	bool adaptive_time_step = false;
+	float adaptive_tolerance = 1e-4f;
+	float adaptive_max_time_step_scale = 10.0f;
+	/// <summary>
+	/// Number of steps of the adaptive solver that were kept and thrown away, and the length of the last step.
+	/// </summary>
+	int accepted_steps = 0;
+	int rejected_steps = 0;
+	float last_time_step = 0.0f;
+	/// <summary>
+	/// Lets the explicit solver subcycle: deltaT is only needed for the stiffest edges, so every vertex gets a
+	/// level l below multirate_levels and takes its steps at 2^l deltaT, the largest such time step that is still
+	/// as stable for all edges at the vertex as deltaT is for the stiffest one. Every step() advances the
+	/// simulation by deltaT, moves all vertices along their velocities and only evaluates the constraints around
+	/// the vertices whose own step starts there; the others keep their force and velocity until then. Where two
+	/// levels meet, a constraint pushes its vertices for different lengths of time, so the rigid motion this
+	/// leaves is removed once every cycle of steps. With edges of the same length everywhere this is the plain
+	/// explicit step. Runs on one thread, and is ignored with adaptive_time_step.
+	/// </summary>
+	bool multirate = false;
+	int multirate_levels = 4;
+	/// <summary>
+	/// Lets the explicit solver put vertices to sleep once their velocity stays below active_set_velocity and
+	/// their net force below active_set_force for active_set_steps steps in a row. A sleeping vertex does not
+	/// move, and only the constraints around the awake vertices and their direct neighbours are evaluated. A
+	/// sleeping neighbour wakes up again once its force grows past twice active_set_force. Changing the fold
+	/// percent, a stiffness or resetConvergence() wakes all vertices. Ignored with adaptive_time_step or multirate.
+	/// </summary>
+	bool active_set = false;
+	float active_set_velocity = 5e-5f;
+	float active_set_force = 1e-3f;
+	int active_set_steps = 20;
+	/// <summary>
+	/// Runs the explicit solver in double precision: the same force passes and steps, adaptive_time_step and
+	/// active_set included, on a double copy of the vertices and of the rest lengths and angles, which are
+	/// computed from the flat pattern when the origami is loaded. After every step the result is rounded into
+	/// vertices for the renderer, the convergence check and everything else; changes made there in the meantime
+	/// are picked up before the next step. The AVX2 edge kernel only exists for float, see enable_simd.
+	/// </summary>
+	bool double_precision = false;
+	/// <summary>
+	/// Fraction of the vertices that were awake during the last active set step.
+	/// </summary>
+	float active_fraction = 1.0f;
+	/// <summary>
+	/// Number of edge, crease and face constraints evaluated by all steps so far.
+	/// </summary>
+	uint64_t constraint_evaluations = 0;
+	/// <summary>
+	/// The implicit solver is stable for any time step; it takes steps of deltaT * implicit_time_step_scale.
+	/// </summary>
+	float implicit_time_step_scale = 20.0f;
+	/// <summary>
+	/// The linear solve of an implicit step stops once the residual is below cg_tolerance times the right hand
+	/// side, or after cg_max_iterations iterations.
+	/// </summary>
+	float cg_tolerance = 1e-5f;
+	int cg_max_iterations = 200;
+	/// <summary>
+	/// Number of conjugate gradient iterations used by the last implicit step.
+	/// </summary>
+	int last_cg_iterations = 0;
+	/// <summary>
+	/// Dynamic relaxation gives every vertex a fictitious mass of relaxation_mass_scale times half its stiffness,
+	/// so that a unit time step is stable. Raise it if the relaxation does not settle.
+	/// </summary>
+	float relaxation_mass_scale = 1.0f;
+	/// <summary>
+	/// Dynamic relaxation stops moving the vertices once last_residual is below this.
+	/// </summary>
+	float relaxation_tolerance = 1e-3f;
+	/// <summary>
+	/// Largest net constraint force on a vertex at the start of the last relaxation step.
+	/// </summary>
+	float last_residual = 0.0f;
+	/// <summary>
+	/// The XPBD solver is stable for any time step as well; it takes steps of deltaT * xpbd_time_step_scale, split
+	/// into xpbd_substeps substeps of xpbd_iterations Gauss-Seidel sweeps over all constraints each. More substeps
+	/// converge much better than more iterations for the same cost.
+	/// </summary>
+	float xpbd_time_step_scale = 20.0f;
+	int xpbd_substeps = 10;
+	int xpbd_iterations = 1;
+
+	/// <summary>
+	/// The simulation has converged once max_velocity is below convergence_velocity and max_force is below
+	/// convergence_force for convergence_steps steps in a row. A tolerance of 0 leaves that quantity out. Dynamic
+	/// relaxation resets the velocities all the time, so for it only last_residual < relaxation_tolerance counts.
+	/// </summary>
+	float convergence_velocity = 1e-4f;
+	float convergence_force = 0.0f;
+	int convergence_steps = 1;
+	/// <summary>
+	/// Updated after every step.
+	/// </summary>
+	ConvergenceStats convergence;
+	/// <summary>
+	/// Lets every pass of computeTotalForce also sum up the energies of the constraints and find their largest
+	/// residuals, into constraint_stats, from the values the kernels compute for the forces anyway. That is every
+	/// step of the explicit, implicit and relaxation solvers, but not the passes of the active set, multirate or
+	/// XPBD that only cover part of the constraints or none at all. With num_threads above 1 the energies
+	/// are summed per thread, so they can differ from the single-threaded ones in the last digits.
+	/// </summary>
+	bool gather_constraint_stats = false;
+	ConstraintStats constraint_stats;
+	/// <summary>
+	/// Moves target_angle_percent towards fold_ramp_target, faster while the largest axial strain and face angle
+	/// error are well below ramp_max_strain and ramp_max_face_error, and not at all while one is over its limit.
+	/// The rate is in fold percent per explicit step, at most fold_ramp_max_rate; convergence waits for the target.
+	/// </summary>
+	bool fold_ramp = false;
+	float fold_ramp_target = 1.0f;
+	float ramp_max_strain = 0.1f;
+	float ramp_max_face_error = 0.2f;
+	float fold_ramp_min_rate = 1e-4f;
+	float fold_ramp_max_rate = 1e-3f;
+	/// <summary>
+	/// Current rate of the ramp, and the strain and face angle error it was last set from.
+	/// </summary>
+	float fold_ramp_rate = 0.0f;
+	float ramp_strain = 0.0f;
+	float ramp_face_error = 0.0f;
+	/// <summary>
+	/// Checks every watchdog_interval steps that the kinetic plus constraint energy has not grown. Damping only
+	/// takes energy out, so the energy can at most reach that of the last checkpoint with the constraints at the
+	/// current fold percent. While it stays below that the checkpoint moves up to the current positions and
+	/// velocities; while it is above, the checkpoint stays where it was. If a step diverges, or the energy gets
+	/// above watchdog_energy_growth times that of the checkpoint, the origami goes back to the checkpoint and
+	/// deltaT and the fold ramp rate are halved. After watchdog_max_rollbacks rollbacks it gives up and the
+	/// simulation counts as diverged. A check costs two passes over the constraints.
+	/// </summary>
+	bool watchdog = false;
+	int watchdog_interval = 50;
+	float watchdog_energy_growth = 2.0f;
+	int watchdog_max_rollbacks = 8;
+	/// <summary>
+	/// Number of times the watchdog rolled back so far.
+	/// </summary>
+	int rollbacks = 0;
+
 	std::string name;
 
 
 //private:
 
+	/// <summary>
+	/// Interleaved per-vertex layout that is uploaded to the GPU. The solver does not store vertices like this,
+	/// see VertexArrays.
+	/// </summary>
 	class VertexData {
 	public:
 		glm::vec3 coords;
@@ -85,7 +396,43 @@ public:
 		}
 	};
 
-	std::vector<VertexData> vertices;
+	/// <summary>
+	/// Solver state of all vertices, stored as one contiguous array per attribute so that the constraint
+	/// passes only stream through the data they actually read. The arrays are padded with zeros to a multiple
+	/// of PADDING entries so vectorized loops never need a scalar tail; size() is the real vertex count.
+	/// T is the scalar type of the solver, see double_precision.
+	/// </summary>
+	template<typename T>
+	class VertexArrays {
+	public:
+		static constexpr size_t PADDING = 8;
+
+		std::vector<Vec3<T>> coords;
+		std::vector<Vec3<T>> velocity;
+		std::vector<Vec3<T>> force;
+
+		size_t size() const {
+			return m_size;
+		}
+
+		void push_back(Vec3<T> position) {
+			resize(m_size + 1);
+			coords[m_size - 1] = position;
+		}
+
+		void resize(size_t size) {
+			m_size = size;
+			size_t padded = (size + PADDING - 1) / PADDING * PADDING;
+			coords.resize(padded, Vec3<T>(0));
+			velocity.resize(padded, Vec3<T>(0));
+			force.resize(padded, Vec3<T>(0));
+		}
+
+	private:
+		size_t m_size = 0;
+	};
+
+	VertexArrays<float> vertices;
 
 	/// <summary>
 	/// Each edge (x, y, z) represents: 
@@ -103,6 +450,14 @@ public:
 	/// </summary>
 	std::vector<glm::uvec2> edge_to_faces;
 	/// <summary>
+	/// For vertex i, the indices of all edges that have it as an endpoint, in increasing order.
+	/// </summary>
+	CsrTable vertex_to_edges;
+	/// <summary>
+	/// For vertex i, the indices of all faces that have it as a corner, in increasing order.
+	/// </summary>
+	CsrTable vertex_to_faces;
+	/// <summary>
 	/// Nominal length of edge i.
 	/// </summary>
 	std::vector<float> nominal_length;
@@ -111,45 +466,466 @@ public:
 	/// </summary>
 	std::vector<glm::vec3> nominal_angles;
 
-	std::vector<glm::vec3> normals;
+	/// <summary>
+	/// Everything about a non-boundary crease that stays the same while simulating.
+	/// p3 and p4 are the endpoints of the crease, p1 and p2 the vertices opposite to it in its two faces.
+	/// </summary>
+	struct CreaseData {
+		unsigned int p1, p2, p3, p4;
+		/// <summary>
+		/// MOUNTAIN_EDGE, VALLEY_EDGE or FACET_EDGE
+		/// </summary>
+		unsigned int type;
+		float nominal_length;
+		/// <summary>
+		/// Target fold angle at 100% fold.
+		/// </summary>
+		float full_target_angle;
+		/// <summary>
+		/// +1 or -1, depending on whether cross(p4 - p3, pX - p3) points the same way as the face's normal.
+		/// </summary>
+		float n1_sign, n2_sign;
+	};
+	std::vector<CreaseData> creases;
+	/// <summary>
+	/// The facet creases come first in creases, followed by the mountain and valley creases, so the force
+	/// loops can run over both ranges with a fixed stiffness instead of looking at the type of every crease.
+	/// </summary>
+	size_t facet_crease_count = 0;
+	/// <summary>
+	/// For vertex i, 4 * crease + k for every crease it is point p(k+1) of, in increasing order.
+	/// </summary>
+	CsrTable vertex_to_creases;
 
 	void normalizeVertices();
-	
-	void prepareGpuMesh();
 
 	/// <summary>
-	/// Calculates the cotangent by the indecies of 3 points in the mesh.
+	/// Builds edge_to_faces, vertex_to_edges and vertex_to_faces in linear time.
 	/// </summary>
-	/// <param name="p1"></param>
-	/// <param name="p2"></param>
-	/// <param name="p3"></param>
-	/// <returns></returns>
-	float cot(unsigned int p1, unsigned int p2, unsigned int p3);
+	void buildAdjacency();
+
+	/// <summary>
+	/// Builds the creases array. Needs the edges, faces, edge_to_faces and nominal lengths.
+	/// </summary>
+	void prepareCreases();
 
 	/// <summary>
 	/// Calculates the angles at each of the three corners of a face.
 	/// </summary>
 	/// <param name="face"></param>
 	/// <returns></returns>
-	glm::vec3 angles(glm::uvec3 face);
-
-	std::vector<VertexData> formatVertices();
-	void prepareEdgeShaderData(std::vector<glm::vec4>& vertexData, std::vector<glm::uvec3>& faceData);
-	void updateNormals();
+	glm::vec3 angles(glm::uvec3 face) const;
 
 	bool intersectWithFace(Ray& ray, unsigned int face);
 
+	/// <summary>
+	/// out = K in and out = D in for the stiffness matrix K (with the sign flipped so it is positive
+	/// semi-definite, and without the terms of the second derivatives of the constraints) and the damping matrix
+	/// D of the enabled constraints at the current positions.
+	/// </summary>
+	void multiplyStiffness(std::span<const glm::vec3> in, std::span<glm::vec3> out) const;
+	void multiplyDamping(std::span<const glm::vec3> in, std::span<glm::vec3> out) const;
 
-	GLuint m_vao_faces;
-	GLuint m_vbo_faces;
-	GLuint m_ibo_faces;
+	/// <summary>
+	/// Fold angle minus its current target, with its gradient with respect to p1..p4.
+	/// </summary>
+	/// <remarks>
+	/// This and the other functions templated on the scalar type T work on vertexState&lt;T&gt;(), which is
+	/// vertices for float and the double precision state for double, see double_precision. T is deduced from
+	/// the output arguments where there are any and is float otherwise.
+	/// </remarks>
+	template<typename T>
+	T creaseAngleError(const CreaseData& crease, Vec3<T> gradient[4]) const;
+	float creaseStiffness(const CreaseData& crease) const;
+	/// <summary>
+	/// gradients[c][p] is the gradient of the angle at corner c with respect to corner p of face i.
+	/// </summary>
+	template<typename T>
+	void faceAngleGradients(unsigned int i, Vec3<T> gradients[3][3]) const;
 
-	GLuint m_vao_edges;
-	GLuint m_vbo_edges;
-	GLuint m_ibo_edges;
+	/// <summary>
+	/// Forces of a single constraint. The axial and damping forces are the ones on edges[i].x, the force on
+	/// edges[i].y is the negation. creaseForce writes the forces on p1..p4 and faceForce the ones on the three corners.
+	/// They also return their residual: the stretch l - L, the angle error of the crease and the differences of
+	/// the face angles from the flat pattern.
+	/// </summary>
+	template<typename T>
+	Vec3<T> axialForce(unsigned int i, T& stretch) const;
+	template<typename T>
+	T creaseForce(const CreaseData& crease, Vec3<T> forces[4]) const;
+	template<typename T>
+	Vec3<T> faceForce(unsigned int i, Vec3<T> forces[3]) const;
+	template<typename T = float>
+	Vec3<T> dampingForceOfEdge(unsigned int i) const;
 
+	/// <summary>
+	/// Sum of the enabled axial and damping forces of edge i, again the one on edges[i].x.
+	/// </summary>
+	template<typename T = float>
+	Vec3<T> edgeForce(unsigned int i, bool axial, bool damping) const;
+	/// <summary>
+	/// edgeForce of the edges begin + j, written to out[j]. Uses the AVX2 kernel if available and falls back
+	/// to edgeForce for the rest. With axial forces and stats, also adds their energies and strains to stats.
+	/// </summary>
+	template<typename T>
+	void computeEdgeForces(size_t begin, size_t end, bool axial, bool damping, Vec3<T>* out, EdgeStats* stats = nullptr) const;
+	/// <summary>
+	/// computeEdgeForces for one combination of its flags, computeEdgeForces picks the right one once per call
+	/// so the loop over the edges does not check them. Stats requires Axial.
+	/// </summary>
+	template<typename T, bool Axial, bool Damping, bool Stats>
+	void computeEdgeForcesImpl(size_t begin, size_t end, Vec3<T>* out, EdgeStats* stats) const;
+	/// <summary>
+	/// creaseForce of the creases from begin to end, with their stiffness per unit length split into k_facet
+	/// and k_fold at facet_crease_count. Passes the forces of crease i to sink(i, forces) and, with Stats, adds
+	/// the energies and angle errors to stats.
+	/// </summary>
+	template<typename T, bool Stats, typename Sink>
+	void creaseForces(size_t begin, size_t end, ConstraintStats& stats, Sink&& sink) const;
+	/// <summary>
+	/// faceForce of the faces from begin to end, the same way as creaseForces.
+	/// </summary>
+	template<typename T, bool Stats, typename Sink>
+	void faceForces(size_t begin, size_t end, ConstraintStats& stats, Sink&& sink) const;
+
+	/// <summary>
+	/// Recomputes the edge constants of solverBuffers&lt;T&gt;() if the edges, EA or damping_ratio changed since
+	/// the last time.
+	/// </summary>
+	template<typename T = float>
+	void updateEdgeConstants();
+
+	/// <summary>
+	/// Adds the forces of one constraint type to the given per-vertex buffer without allocating. The axial and
+	/// damping forces are done in a single pass over the edges, either one can be left out. With stats, the
+	/// energies and residuals of the constraints are added to it in the same pass.
+	/// </summary>
+	template<typename T>
+	void addEdgeForces(std::vector<Vec3<T>>& forces, bool axial, bool damping, ConstraintStats* stats = nullptr);
+	template<typename T>
+	void addCreaseForces(std::vector<Vec3<T>>& forces, ConstraintStats* stats = nullptr);
+	template<typename T>
+	void addFaceForces(std::vector<Vec3<T>>& forces, ConstraintStats* stats = nullptr);
+
+	/// <summary>
+	/// Accumulates all enabled constraints into vertexState&lt;T&gt;().force. In double precision the result is
+	/// also rounded into vertices.force.
+	/// </summary>
+	template<typename T = float>
+	void computeTotalForce();
+	/// <summary>
+	/// Same result as the serial path, but split over num_threads threads. Every constraint first writes its
+	/// forces into its own slots, after which every vertex gathers the slots of its constraints in order.
+	/// </summary>
+	template<typename T>
+	void computeTotalForceParallel();
+	/// <summary>
+	/// enable_damping_force, except for dynamic relaxation which never uses the damping force.
+	/// </summary>
+	bool dampingForceEnabled() const;
+	ThreadPool& threadPool();
+
+	/// <summary>
+	/// Step of the explicit solver in the scalar type T: stepAdaptive, stepMultirate, stepActiveSet or a plain
+	/// integrateExplicit of deltaT.
+	/// </summary>
+	template<typename T>
+	void stepExplicit();
+	/// <summary>
+	/// Fills the double precision rest lengths and angles from the current positions, which must be the flat
+	/// pattern.
+	/// </summary>
+	void prepareDoubleRestShape();
+	/// <summary>
+	/// Brings the double precision state up to date before a double precision step: fills in the rest shape if
+	/// it is missing and takes over every vertex whose float position or velocity was changed since the last
+	/// step, by a rollback, the static solver or another solver.
+	/// </summary>
+	void loadDoubleVertices();
+	/// <summary>
+	/// Rounds the double precision state of the vertices from begin to end into vertices.
+	/// </summary>
+	void storeDoubleVertices(size_t begin, size_t end);
+	/// <summary>
+	/// Symplectic Euler step of length dt from the forces in vertexState&lt;T&gt;().force, computing them first
+	/// if needed.
+	/// </summary>
+	template<typename T = float>
+	void integrateExplicit(float dt);
+	/// <summary>
+	/// Explicit step with error control, see adaptive_time_step.
+	/// </summary>
+	template<typename T>
+	void stepAdaptive();
+	/// <summary>
+	/// Explicit step of deltaT that only evaluates the constraints around the vertices whose own step starts,
+	/// see multirate.
+	/// </summary>
+	template<typename T>
+	void stepMultirate();
+	/// <summary>
+	/// Assigns every vertex its level and groups the vertices and constraints by level, if the constraints or
+	/// multirate_levels changed since the last time.
+	/// </summary>
+	void prepareMultirate();
+	/// <summary>
+	/// Fills convergence from the velocities and forces after a step.
+	/// </summary>
+	void updateConvergence();
+	/// <summary>
+	/// Moves target_angle_percent one step along the fold ramp, see fold_ramp.
+	/// </summary>
+	void advanceFoldRamp();
+	/// <summary>
+	/// Takes a checkpoint or rolls back to the last one after a step, see watchdog.
+	/// </summary>
+	void checkWatchdog();
+	void saveWatchdogCheckpoint();
+	/// <summary>
+	/// Energy of the axial, crease and face constraints with the vertices at coords, see ConstraintStats.
+	/// </summary>
+	double constraintEnergy(std::span<const glm::vec3> coords);
+	/// <summary>
+	/// Explicit step of only the awake vertices, see active_set.
+	/// </summary>
+	template<typename T>
+	void stepActiveSet();
+	/// <summary>
+	/// Fills the lists of vertices and constraints to evaluate from the awake vertices, which can only be
+	/// among the vertices evaluated so far.
+	/// </summary>
+	void rebuildActiveSet();
+	/// <summary>
+	/// Linearized backward Euler step: solves (I - dt D - dt^2 K) dv = dt (f + dt K v) for the change in velocity,
+	/// with K the Gauss-Newton approximation of the stiffness matrix (always negative semi-definite) and D the
+	/// damping matrix.
+	/// </summary>
+	void stepImplicit();
+	/// <summary>
+	/// Builds the sparsity pattern of the implicit system and the block slots of every constraint, if the
+	/// topology changed since the last time.
+	/// </summary>
+	void prepareImplicitSolver();
+	/// <summary>
+	/// Fills m_system with I - dt D - dt^2 K and m_implicit_rhs with dt (f + dt K v). Needs vertices.force.
+	/// </summary>
+	void assembleImplicitSystem(float dt);
+	/// <summary>
+	/// Dynamic relaxation: explicit steps of unit length with fictitious masses and no damping force. Instead the
+	/// vertices are stopped whenever the kinetic energy has passed a peak, which is where the motion is closest
+	/// to the equilibrium. Only the rest shape is meaningful, the motion on the way there is not physical.
+	/// </summary>
+	void stepRelaxation();
+	/// <summary>
+	/// Sets m_relaxation_mass from the row sums of the stiffness matrix at the current positions (a Gershgorin
+	/// bound on its largest eigenvalue).
+	/// </summary>
+	void updateRelaxationMasses();
+	/// <summary>
+	/// Extended position based dynamics: every constraint is projected in turn, with a compliance of one over
+	/// its stiffness so that the rest shape is the same as that of the other solvers. The constraints are
+	/// colored so that no two of one color share a vertex, and a color is projected in parallel.
+	/// </summary>
+	void stepXpbd();
+	/// <summary>
+	/// Colors the edges, creases and faces if the topology changed since the last time.
+	/// </summary>
+	void prepareXpbd();
+	/// <summary>
+	/// Projects a single constraint and updates its multiplier in m_xpbd_lambda.
+	/// </summary>
+	void projectAxialConstraint(unsigned int i, float dt);
+	void projectCreaseConstraint(unsigned int i, float dt);
+	void projectFaceConstraint(unsigned int i, float dt);
+	/// <summary>
+	/// Applies the damping force of edge i to the velocities of its endpoints.
+	/// </summary>
+	void dampEdgeVelocity(unsigned int i, float dt);
+	/// <summary>
+	/// Removes the rigid translation and rotation from the velocities. There are no external forces and every
+	/// simulation starts at rest, so both should be zero; the XPBD projections only keep the momentum and angular
+	/// momentum up to rounding errors and to first order respectively, and multirate steps do not keep them
+	/// where the levels meet.
+	/// </summary>
+	template<typename T = float>
+	void removeRigidMotion();
+
+	/// <summary>
+	/// True if vertices.force holds the total force at the current positions. m_force_cache_double tells whether
+	/// it was computed in double precision, in which case the double forces are known as well.
+	/// </summary>
 	bool m_force_cache_used = false;
-	std::vector<glm::vec3> m_total_force_cache;
+	bool m_force_cache_double = false;
+
+	/// <summary>
+	/// What the force passes and the explicit steps keep per scalar type besides the vertices.
+	/// </summary>
+	template<typename T>
+	struct SolverBuffers {
+		EdgeConstants<T> edge_constants;
+		// per-constraint force slots used by computeTotalForceParallel, edge_forces holds axial plus damping
+		std::vector<Vec3<T>> edge_forces;
+		std::vector<Vec3<T>> crease_forces;
+		std::vector<Vec3<T>> face_forces;
+		// adaptive time step: the state at the start of the step for rolling back
+		std::vector<Vec3<T>> start_coords;
+		std::vector<Vec3<T>> start_velocity;
+		std::vector<Vec3<T>> start_force;
+	};
+
+	/// <summary>
+	/// The state the solver works on in the scalar type T: vertices and m_float_buffers for float, the double
+	/// precision copies for double. forcesCached&lt;T&gt;() is m_force_cache_used for forces computed in T.
+	/// </summary>
+	template<typename T>
+	VertexArrays<T>& vertexState() {
+		if constexpr (std::is_same_v<T, float>) {
+			return vertices;
+		} else {
+			return m_double_vertices;
+		}
+	}
+	template<typename T>
+	const VertexArrays<T>& vertexState() const {
+		if constexpr (std::is_same_v<T, float>) {
+			return vertices;
+		} else {
+			return m_double_vertices;
+		}
+	}
+	template<typename T>
+	SolverBuffers<T>& solverBuffers() {
+		if constexpr (std::is_same_v<T, float>) {
+			return m_float_buffers;
+		} else {
+			return m_double_buffers;
+		}
+	}
+	template<typename T>
+	const SolverBuffers<T>& solverBuffers() const {
+		if constexpr (std::is_same_v<T, float>) {
+			return m_float_buffers;
+		} else {
+			return m_double_buffers;
+		}
+	}
+	template<typename T>
+	const std::vector<T>& restLengths() const {
+		if constexpr (std::is_same_v<T, float>) {
+			return nominal_length;
+		} else {
+			return m_double_nominal_length;
+		}
+	}
+	template<typename T>
+	const std::vector<Vec3<T>>& restAngles() const {
+		if constexpr (std::is_same_v<T, float>) {
+			return nominal_angles;
+		} else {
+			return m_double_nominal_angles;
+		}
+	}
+	template<typename T>
+	bool forcesCached() const {
+		return m_force_cache_used && m_force_cache_double == std::is_same_v<T, double>;
+	}
+
+	SolverBuffers<float> m_float_buffers;
+	// constraint stats of the range of every thread, see gather_constraint_stats
+	std::vector<ConstraintStats> m_chunk_stats;
+
+	// implicit solver
+	BlockSparseMatrix m_system;
+	// slots of the (x, x), (x, y), (y, x) and (y, y) blocks of every edge
+	std::vector<glm::uvec4> m_edge_slots;
+	// slots of the 4x4 blocks of every crease and the 3x3 blocks of every face, row major
+	std::vector<unsigned int> m_crease_slots;
+	std::vector<unsigned int> m_face_slots;
+	std::vector<glm::mat3> m_system_diagonal_inverse;
+	std::vector<glm::vec3> m_implicit_rhs;
+	std::vector<glm::vec3> m_velocity_change;
+	ConjugateGradientWorkspace m_cg_workspace;
+
+	// adaptive time step: the step to try next, the state at the start of the step is in SolverBuffers
+	float m_adaptive_time_step = 0.0f;
+	// error of the last accepted step relative to adaptive_tolerance
+	float m_last_error_ratio = 1.0f;
+
+	// Active set: per vertex whether it is awake and for how many steps it has been below the thresholds. Empty
+	// when all vertices have to be woken up at the next active set step.
+	std::vector<uint8_t> m_awake;
+	std::vector<int> m_sleep_counter;
+	// The vertices to evaluate (the awake ones and their neighbours) and all constraints around them, with
+	// marks for which are in the lists. m_active_set_dirty is set when a vertex woke up, m_active_set_sleepers
+	// counts the vertices that fell asleep since the lists were built. The number of awake vertices after the
+	// last step and when the lists were built.
+	std::vector<unsigned int> m_active_vertices;
+	std::vector<unsigned int> m_active_edges;
+	std::vector<unsigned int> m_active_creases;
+	std::vector<unsigned int> m_active_faces;
+	std::vector<uint8_t> m_active_vertex_marks;
+	std::vector<uint8_t> m_active_edge_marks;
+	std::vector<uint8_t> m_active_crease_marks;
+	std::vector<uint8_t> m_active_face_marks;
+	bool m_active_set_dirty = true;
+	size_t m_active_set_sleepers = 0;
+	size_t m_active_set_awake = 0;
+	size_t m_active_set_awake_at_rebuild = 0;
+	// fold percent, stiffnesses and enabled constraints the sleeping vertices are in equilibrium for
+	std::array<float, 8> m_active_set_parameters{};
+
+	// Multirate: the level of every vertex, and the vertices, edges, creases and faces by level. A constraint
+	// has the lowest level of its vertices, so the ones of the levels up to l are all that touch a vertex of
+	// those levels. The position in the cycle of 2^m_multirate_max_level steps and the multirate_levels the
+	// levels were computed for.
+	std::vector<unsigned int> m_multirate_vertex_level;
+	CsrTable m_multirate_vertices;
+	CsrTable m_multirate_edges;
+	CsrTable m_multirate_creases;
+	CsrTable m_multirate_faces;
+	unsigned int m_multirate_max_level = 0;
+	unsigned int m_multirate_step = 0;
+	int m_multirate_built_levels = 0;
+
+	// steps taken by the fold ramp since it last measured the strain
+	int m_fold_ramp_counter = 0;
+	// fold percent of the last spectral time step estimate and the steps since, and the largest eigenvalue of
+	// the damping matrix, which only changes with the EA and damping_ratio it was computed for
+	float m_time_step_percent = 0.0f;
+	int m_time_step_counter = 0;
+	double m_damping_eigenvalue = -1.0;
+	float m_damping_eigenvalue_EA = 0.0f;
+	float m_damping_eigenvalue_ratio = 0.0f;
+
+	// Watchdog: the checkpoint, its kinetic energy and the steps since the last check
+	std::vector<glm::vec3> m_checkpoint_coords;
+	std::vector<glm::vec3> m_checkpoint_velocity;
+	float m_checkpoint_target_angle_percent = 0.0f;
+	float m_checkpoint_fold_ramp_rate = 0.0f;
+	double m_checkpoint_kinetic_energy = 0.0;
+	int m_watchdog_counter = 0;
+
+	// dynamic relaxation
+	std::vector<float> m_relaxation_mass;
+	double m_kinetic_energy = 0.0;
+	// true if the vertices were just stopped, the next step is then only half a step
+	bool m_relaxation_restart = true;
+
+	// XPBD: row c holds the constraints of color c
+	CsrTable m_edge_colors;
+	CsrTable m_crease_colors;
+	CsrTable m_face_colors;
+	// multipliers of the edges, then the creases, then three per face
+	std::vector<float> m_xpbd_lambda;
+	std::vector<glm::vec3> m_previous_coords;
+
+	// double precision explicit solver: its vertices, buffers and rest shape, see double_precision
+	VertexArrays<double> m_double_vertices;
+	SolverBuffers<double> m_double_buffers;
+	std::vector<double> m_double_nominal_length;
+	std::vector<glm::dvec3> m_double_nominal_angles;
+
+	std::shared_ptr<ThreadPool> m_thread_pool;
 };
 
 unsigned int opposite_vertex(glm::uvec3 face, glm::uvec3 edge);
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "origami_renderer.h"
+#include <glm/gtc/type_ptr.hpp>
+
+OrigamiRenderer::OrigamiRenderer()
+{
+
+}
+
+void OrigamiRenderer::load(Origami& origami)
+{
+	// Create VAO and bind it so subsequent creations of VBO and IBO are bound to this VAO
+	glGenVertexArrays(1, &m_vao_faces);
+	glBindVertexArray(m_vao_faces);
+
+	// Create vertex buffer object (VBO)
+	glGenBuffers(1, &m_vbo_faces);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_faces);
+
+	// Create index buffer object (IBO)
+	glGenBuffers(1, &m_ibo_faces);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_faces);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(origami.faces.size() * sizeof(decltype(origami.faces)::value_type)), origami.faces.data(), GL_STATIC_DRAW);
+
+	// We tell OpenGL what each vertex looks like and how they are mapped to the shader (location = ...).
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Origami::VertexData), (void*)offsetof(Origami::VertexData, coords));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Origami::VertexData), (void*)offsetof(Origami::VertexData, force));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Origami::VertexData), (void*)offsetof(Origami::VertexData, velocity));
+	glVertexAttribDivisor(0, 0);
+	glVertexAttribDivisor(1, 0);
+	glVertexAttribDivisor(2, 0);
+
+	// The edges are drawn from the same vertex buffer, a geometry shader turns each of them into a prism.
+	glGenVertexArrays(1, &m_vao_edges);
+	glBindVertexArray(m_vao_edges);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_faces);
+
+	std::vector<glm::uvec4> edgeIndices;
+	std::vector<glm::vec3> edgeData;
+	prepareEdgeShaderData(origami, edgeIndices, edgeData);
+
+	glGenBuffers(1, &m_ibo_edges);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_edges);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(edgeIndices.size() * sizeof(decltype(edgeIndices)::value_type)), edgeIndices.data(), GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Origami::VertexData), (void*)offsetof(Origami::VertexData, coords));
+
+	// The type and face windings of every edge, read in the geometry shader with gl_PrimitiveIDIn.
+	glGenBuffers(1, &m_edge_data_buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_edge_data_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(edgeData.size() * sizeof(decltype(edgeData)::value_type)), edgeData.data(), GL_STATIC_DRAW);
+	glGenTextures(1, &m_edge_data_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, m_edge_data_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, m_edge_data_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// update the data in the buffers
+	update(origami);
+}
+
+void OrigamiRenderer::update(Origami& origami)
+{
+	formatVertices(origami, m_formatted_vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_faces);
+	streamArrayBuffer(m_formatted_vertices);
+}
+
+template<typename T>
+void OrigamiRenderer::streamArrayBuffer(const std::vector<T>& data)
+{
+	GLsizeiptr size = static_cast<GLsizeiptr>(data.size() * sizeof(T));
+	glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data.data());
+}
+
+void OrigamiRenderer::draw(Origami& origami, const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, Settings& settings)
+{
+	// draw faces
+	face_shader.bind();
+	glUniformMatrix4fv(face_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+	glUniform1i(face_shader.getUniformLocation("renderMode"), settings.renderMode);
+	glUniform1f(face_shader.getUniformLocation("magnitudeCutoff"), settings.magnitudeCutoff);
+
+	glm::vec3 selectedPoint = origami.getSelectedPoint(settings);
+	glUniform1i(face_shader.getUniformLocation("useSelectedPoint"), settings.useSelectedPoint ? 1 : 0);
+	glUniform3f(face_shader.getUniformLocation("selectedPoint"), selectedPoint.x, selectedPoint.y, selectedPoint.z);
+	glUniform1f(face_shader.getUniformLocation("selectedPointRadius"), settings.selectedPointRadius);
+
+	glBindVertexArray(m_vao_faces);
+	glDrawElements(GL_TRIANGLES, 3*origami.faces.size(), GL_UNSIGNED_INT, nullptr);
+
+	//draw edges
+	edge_shader.bind();
+	glUniformMatrix4fv(edge_shader.getUniformLocation("mvpMatrix"), 1, GL_FALSE, glm::value_ptr(mvpMatrix));
+	glUniform1i(edge_shader.getUniformLocation("showFacetEdges"), settings.showFacetEdges ? 1 : 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, m_edge_data_texture);
+	glUniform1i(edge_shader.getUniformLocation("edgeData"), 0);
+	glBindVertexArray(m_vao_edges);
+	glDrawElements(GL_LINES_ADJACENCY, 4*origami.edges.size(), GL_UNSIGNED_INT, nullptr);
+}
+
+void OrigamiRenderer::free()
+{
+	glDeleteVertexArrays(1, &m_vao_faces);
+	glDeleteBuffers(1, &m_vbo_faces);
+	glDeleteBuffers(1, &m_ibo_faces);
+
+	glDeleteVertexArrays(1, &m_vao_edges);
+	glDeleteBuffers(1, &m_ibo_edges);
+	glDeleteBuffers(1, &m_edge_data_buffer);
+	glDeleteTextures(1, &m_edge_data_texture);
+}
+
+void OrigamiRenderer::formatVertices(Origami& origami, std::vector<Origami::VertexData>& formatted)
+{
+	// the solver keeps its state in separate arrays, the shaders expect it interleaved
+	formatted.clear();
+	for (int i = 0; i < origami.vertices.size(); i++) {
+		formatted.push_back(Origami::VertexData(origami.vertices.coords[i], origami.vertices.force[i], origami.vertices.velocity[i]));
+	}
+}
+
+/// <summary>
+/// +1 if the corners a and b come one after the other in the winding order of the face, -1 otherwise.
+/// </summary>
+static float windingSign(glm::uvec3 face, unsigned int a, unsigned int b)
+{
+	if ((face.x == a && face.y == b) || (face.y == a && face.z == b) || (face.z == a && face.x == b)) {
+		return 1.0f;
+	}
+	return -1.0f;
+}
+
+void OrigamiRenderer::prepareEdgeShaderData(Origami& origami, std::vector<glm::uvec4>& indices, std::vector<glm::vec3>& edgeData)
+{
+	const auto& edges = origami.edges;
+	const auto& faces = origami.faces;
+	const auto& edge_to_faces = origami.edge_to_faces;
+	indices.clear();
+	edgeData.clear();
+	for (size_t i = 0; i < edges.size(); i++) {
+		glm::uvec3 face1 = faces[edge_to_faces[i].x];
+		glm::uvec3 face2 = faces[edge_to_faces[i].y];
+		indices.push_back(glm::uvec4(opposite_vertex(face1, edges[i]), edges[i].x, edges[i].y, opposite_vertex(face2, edges[i])));
+		edgeData.push_back(glm::vec3(float(edges[i].z), windingSign(face1, edges[i].x, edges[i].y), windingSign(face2, edges[i].x, edges[i].y)));
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <glm/ext/vector_float3.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include <framework/shader.h>
+#include "settings.h"
+#include "origami.h"
+
+/// <summary>
+/// Owns the GPU buffers used to draw an origami. The simulation itself lives in Origami and does not
+/// touch OpenGL, so it can also run without a window.
+/// </summary>
+class OrigamiRenderer {
+
+public:
+	OrigamiRenderer();
+
+	/// <summary>
+	/// Creates the buffers for the given origami and uploads its current state. The index buffers only depend on
+	/// the topology and are uploaded here once.
+	/// </summary>
+	void load(Origami& origami);
+	/// <summary>
+	/// Uploads the current vertex positions, forces and velocities. Call this at most once per frame, after all
+	/// the steps of that frame.
+	/// </summary>
+	void update(Origami& origami);
+	void draw(Origami& origami, const Shader& face_shader, const Shader& edge_shader, glm::mat4 mvpMatrix, Settings& settings);
+	void free();
+
+private:
+
+	void formatVertices(Origami& origami, std::vector<Origami::VertexData>& formatted);
+	/// <summary>
+	/// The GL_LINES_ADJACENCY indices (opposite vertex in the first face, the two endpoints, opposite vertex in
+	/// the second face) and the per-edge data the edge geometry shader uses to build the edge prisms.
+	/// </summary>
+	void prepareEdgeShaderData(Origami& origami, std::vector<glm::uvec4>& indices, std::vector<glm::vec3>& edgeData);
+
+	/// <summary>
+	/// Replaces the contents of the bound GL_ARRAY_BUFFER. The old storage is orphaned first so the driver
+	/// does not have to wait for draws that still read from it.
+	/// </summary>
+	template<typename T>
+	void streamArrayBuffer(const std::vector<T>& data);
+
+	// kept between updates so uploading does not allocate
+	std::vector<Origami::VertexData> m_formatted_vertices;
+
+	GLuint m_vao_faces;
+	GLuint m_vbo_faces;
+	GLuint m_ibo_faces;
+
+	// the edges read their positions from m_vbo_faces
+	GLuint m_vao_edges;
+	GLuint m_ibo_edges;
+	GLuint m_edge_data_buffer;
+	GLuint m_edge_data_texture;
+};
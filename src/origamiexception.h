@@ -8,15 +8,15 @@ class OrigamiException
 public:
 
     OrigamiException(const char* message)
-        : std::exception(message) {
+        : std::exception() {
         m_message = message;
     }
 
     virtual const char* what() const throw()
     {
-        return m_message;
+        return m_message.c_str();
     }
 
 private:
-    const char* m_message;
-};
\ No newline at end of file
+    std::string m_message;
+};
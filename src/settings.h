@@ -7,6 +7,7 @@ public:
     bool simulate = true;
     bool showFacetEdges = false;
     int steps_per_frame = 5;
+    bool stop_when_converged = true; // stop stepping once the origami has settled, until the UI is touched
     int renderMode = 0;
     int numberOfStepsToTake = 3;
     float magnitudeCutoff = 0.3f; // used for visualising force/velocity, max value to clamp to
@@ -0,0 +1,362 @@
+#include "static_solver.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "constraint_kernels.h"
+
+/// <summary>
+/// Largest length of the vectors, i.e. the largest net force on a single vertex for a gradient.
+/// </summary>
+static double maxNorm(std::span<const glm::vec3> v)
+{
+	double largest = 0.0;
+	for (const glm::vec3& x : v) {
+		largest = std::max(largest, double(glm::length(x)));
+	}
+	return largest;
+}
+
+double StaticSolver::evaluate(Origami& origami, bool gradients)
+{
+	const auto& coords = origami.vertices.coords;
+	auto position = [&coords](unsigned int v) { return glm::dvec3(coords[v]); };
+	double energy = 0.0;
+	if (gradients) {
+		m_gradient_sum.assign(origami.vertices.size(), glm::dvec3(0));
+		m_edge_directions.resize(origami.edges.size());
+		m_crease_stiffness.resize(origami.creases.size());
+		m_crease_gradients.resize(4 * origami.creases.size());
+		m_face_gradients.resize(9 * origami.faces.size());
+	}
+
+	if (origami.enable_axial_constraints) {
+		for (size_t i = 0; i < origami.edges.size(); i++) {
+			const glm::uvec3& edge = origami.edges[i];
+			const double k = double(origami.EA / origami.nominal_length[i]);
+			const glm::dvec3 d = position(edge.x) - position(edge.y);
+			const double stretch = glm::length(d) - double(origami.nominal_length[i]);
+			energy += 0.5 * k * stretch * stretch;
+			if (gradients) {
+				const glm::dvec3 n = glm::normalize(d);
+				m_edge_directions[i] = glm::vec3(n);
+				m_gradient_sum[edge.x] += k * stretch * n;
+				m_gradient_sum[edge.y] -= k * stretch * n;
+			}
+		}
+	}
+
+	if (origami.enable_crease_constraints) {
+		glm::dvec3 g[4];
+		for (size_t i = 0; i < origami.creases.size(); i++) {
+			const Origami::CreaseData& crease = origami.creases[i];
+			const double target = double(crease.full_target_angle) * double(origami.target_angle_percent);
+			const double error = creaseAngleError(position(crease.p1), position(crease.p2), position(crease.p3), position(crease.p4),
+				double(crease.n1_sign), double(crease.n2_sign), target, g);
+			const double k = double(origami.creaseStiffness(crease));
+			energy += 0.5 * k * error * error;
+			if (gradients) {
+				const unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+				m_crease_stiffness[i] = float(k);
+				for (size_t a = 0; a < 4; a++) {
+					m_crease_gradients[4 * i + a] = glm::vec3(g[a]);
+					m_gradient_sum[stencil[a]] += k * error * g[a];
+				}
+			}
+		}
+	}
+
+	if (origami.enable_face_constraints) {
+		const double k = double(origami.k_face);
+		glm::dvec3 g[3][3];
+		for (size_t i = 0; i < origami.faces.size(); i++) {
+			const glm::uvec3& face = origami.faces[i];
+			const glm::dvec3 p1 = position(face.x);
+			const glm::dvec3 p2 = position(face.y);
+			const glm::dvec3 p3 = position(face.z);
+			const glm::dvec3 error = triangleAngles(p1, p2, p3) - glm::dvec3(origami.nominal_angles[i]);
+			energy += 0.5 * k * glm::dot(error, error);
+			if (gradients) {
+				triangleAngleGradients(p1, p2, p3, g);
+				const unsigned int stencil[3] = { face.x, face.y, face.z };
+				for (size_t c = 0; c < 3; c++) {
+					for (size_t a = 0; a < 3; a++) {
+						m_face_gradients[9 * i + 3 * c + a] = glm::vec3(g[c][a]);
+						m_gradient_sum[stencil[a]] += k * error[static_cast<glm::length_t>(c)] * g[c][a];
+					}
+				}
+			}
+		}
+	}
+
+	if (gradients) {
+		m_gradient.resize(origami.vertices.size());
+		for (size_t i = 0; i < m_gradient.size(); i++) {
+			m_gradient[i] = glm::vec3(m_gradient_sum[i]);
+		}
+	}
+	return energy;
+}
+
+void StaticSolver::multiplyHessian(const Origami& origami, std::span<const glm::vec3> in, std::span<glm::vec3> out) const
+{
+	for (size_t i = 0; i < in.size(); i++) {
+		out[i] = m_mu * in[i];
+	}
+
+	if (origami.enable_axial_constraints) {
+		for (size_t i = 0; i < origami.edges.size(); i++) {
+			const glm::uvec3& edge = origami.edges[i];
+			const float k = origami.EA / origami.nominal_length[i];
+			const glm::vec3& n = m_edge_directions[i];
+			const glm::vec3 f = (k * glm::dot(n, in[edge.x] - in[edge.y])) * n;
+			out[edge.x] += f;
+			out[edge.y] -= f;
+		}
+	}
+
+	if (origami.enable_crease_constraints) {
+		for (size_t i = 0; i < origami.creases.size(); i++) {
+			const Origami::CreaseData& crease = origami.creases[i];
+			const unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+			const glm::vec3* g = &m_crease_gradients[4 * i];
+			float s = 0.0f;
+			for (int a = 0; a < 4; a++) {
+				s += glm::dot(g[a], in[stencil[a]]);
+			}
+			s *= m_crease_stiffness[i];
+			for (int a = 0; a < 4; a++) {
+				out[stencil[a]] += s * g[a];
+			}
+		}
+	}
+
+	if (origami.enable_face_constraints) {
+		for (size_t i = 0; i < origami.faces.size(); i++) {
+			const glm::uvec3& face = origami.faces[i];
+			const unsigned int stencil[3] = { face.x, face.y, face.z };
+			for (size_t c = 0; c < 3; c++) {
+				const glm::vec3* g = &m_face_gradients[9 * i + 3 * c];
+				float s = 0.0f;
+				for (int a = 0; a < 3; a++) {
+					s += glm::dot(g[a], in[stencil[a]]);
+				}
+				s *= origami.k_face;
+				for (int a = 0; a < 3; a++) {
+					out[stencil[a]] += s * g[a];
+				}
+			}
+		}
+	}
+}
+
+StaticSolveResult StaticSolver::solve(Origami& origami)
+{
+	StaticSolveResult result;
+	const size_t n = origami.vertices.size();
+	auto& coords = origami.vertices.coords;
+	std::vector<glm::mat3> diagonal;
+
+	double energy = evaluate(origami, true);
+	double residual = maxNorm(m_gradient);
+	const double startResidual = residual;
+	// the last iteration that halved the residual
+	double progressResidual = residual;
+	int progressIteration = 0;
+	// the iterate with the smallest residual so far, where the solve ends up if it does not converge
+	double bestResidual = residual;
+	m_best.assign(coords.begin(), coords.begin() + static_cast<std::ptrdiff_t>(n));
+	// Levenberg damping, relative to the average diagonal of H like the regularization
+	float damping = 0.0f;
+	while (true) {
+		if (residual < double(tolerance)) {
+			result.converged = true;
+			break;
+		}
+		if (result.iterations >= max_iterations || damping > max_damping) {
+			break;
+		}
+		// The energy can go on decreasing towards a collapsed face, where the angle gradients blow up. That is
+		// not an equilibrium and it does not come back from there. Snapping through to another equilibrium
+		// raises the residual as well, but by far less.
+		if (residual > double(max_residual_growth) * startResidual) {
+			break;
+		}
+		if (result.iterations - progressIteration >= stall_iterations) {
+			break;
+		}
+		result.iterations++;
+
+		// block Jacobi preconditioner made of the diagonal blocks of H, plus the regularization and damping
+		diagonal.assign(n, glm::mat3(0.0f));
+		if (origami.enable_axial_constraints) {
+			for (size_t i = 0; i < origami.edges.size(); i++) {
+				const glm::mat3 block = (origami.EA / origami.nominal_length[i]) * glm::outerProduct(m_edge_directions[i], m_edge_directions[i]);
+				diagonal[origami.edges[i].x] += block;
+				diagonal[origami.edges[i].y] += block;
+			}
+		}
+		if (origami.enable_crease_constraints) {
+			for (size_t i = 0; i < origami.creases.size(); i++) {
+				const Origami::CreaseData& crease = origami.creases[i];
+				const unsigned int stencil[4] = { crease.p1, crease.p2, crease.p3, crease.p4 };
+				for (size_t a = 0; a < 4; a++) {
+					const glm::vec3& g = m_crease_gradients[4 * i + a];
+					diagonal[stencil[a]] += m_crease_stiffness[i] * glm::outerProduct(g, g);
+				}
+			}
+		}
+		if (origami.enable_face_constraints) {
+			for (size_t i = 0; i < origami.faces.size(); i++) {
+				const glm::uvec3& face = origami.faces[i];
+				const unsigned int stencil[3] = { face.x, face.y, face.z };
+				for (size_t c = 0; c < 3; c++) {
+					for (size_t a = 0; a < 3; a++) {
+						const glm::vec3& g = m_face_gradients[9 * i + 3 * c + a];
+						diagonal[stencil[a]] += origami.k_face * glm::outerProduct(g, g);
+					}
+				}
+			}
+		}
+		double trace = 0.0;
+		for (const glm::mat3& block : diagonal) {
+			trace += double(block[0][0] + block[1][1] + block[2][2]);
+		}
+		m_mu = (regularization + damping) * float(trace / double(3 * n));
+		m_diagonal_inverse.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			m_diagonal_inverse[i] = glm::inverse(diagonal[i] + m_mu * glm::mat3(1.0f));
+		}
+
+		// Newton step, solved only as accurately as needed this far from the solution
+		m_step.assign(n, glm::vec3(0));
+		m_rhs.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			m_rhs[i] = -m_gradient[i];
+		}
+		const float forcing = float(std::min(0.1, std::sqrt(residual)));
+		ConjugateGradientResult cg = conjugateGradient(std::span<const glm::vec3>(m_rhs), std::span<glm::vec3>(m_step),
+			[&](std::span<const glm::vec3> in, std::span<glm::vec3> out) { multiplyHessian(origami, in, out); },
+			[&](std::span<const glm::vec3> in, std::span<glm::vec3> out) {
+				for (size_t i = 0; i < n; i++) {
+					out[i] = m_diagonal_inverse[i] * in[i];
+				}
+			},
+			forcing, cg_max_iterations, m_cg_workspace);
+		result.cg_iterations += cg.iterations;
+		// Far from the solution the linear model can ask for huge steps that jump into another equilibrium, so
+		// no vertex is moved further than max_step_length in one iteration.
+		float longest = 0.0f;
+		for (const glm::vec3& d : m_step) {
+			longest = std::max(longest, glm::length(d));
+		}
+		if (longest > max_step_length) {
+			for (glm::vec3& d : m_step) {
+				d *= max_step_length / longest;
+			}
+		}
+		const double slope = dotProduct(m_gradient, m_step);
+		m_start.assign(coords.begin(), coords.begin() + static_cast<std::ptrdiff_t>(n));
+
+		// Backtracking line search on the energy. Close to the minimum the expected decrease is smaller than the
+		// change of the energy from rounding the positions to float, and the energy says nothing about a step.
+		// There the full step is taken if it brings the forces down.
+		const bool noisy = slope < 0.0 && -slope < 1e-10 * energy;
+		bool accepted = noisy;
+		bool fullStep = true;
+		float alpha = 1.0f;
+		for (int attempt = 0; attempt < 10 && slope < 0.0 && !noisy; attempt++) {
+			for (size_t i = 0; i < n; i++) {
+				coords[i] = m_start[i] + alpha * m_step[i];
+			}
+			double trial = evaluate(origami, false);
+			if (std::isfinite(trial) && trial <= energy + 1e-4 * double(alpha) * slope) {
+				accepted = true;
+				break;
+			}
+			alpha *= 0.5f;
+			fullStep = false;
+		}
+		if (noisy) {
+			for (size_t i = 0; i < n; i++) {
+				coords[i] = m_start[i] + m_step[i];
+			}
+		}
+		const double newEnergy = accepted ? evaluate(origami, true) : energy;
+		const double newResidual = accepted ? maxNorm(m_gradient) : residual;
+		if (noisy) {
+			accepted = newResidual < residual;
+		}
+		if (!accepted || !std::isfinite(newResidual)) {
+			// go back and try again with more damping, which gives a shorter step that turns towards steepest descent
+			std::copy(m_start.begin(), m_start.end(), coords.begin());
+			energy = evaluate(origami, true);
+			residual = maxNorm(m_gradient);
+			damping = std::max(10.0f * damping, min_damping);
+			continue;
+		}
+		energy = newEnergy;
+		residual = newResidual;
+		if (residual < bestResidual) {
+			bestResidual = residual;
+			m_best.assign(coords.begin(), coords.begin() + static_cast<std::ptrdiff_t>(n));
+		}
+		if (residual < 0.5 * progressResidual) {
+			progressResidual = residual;
+			progressIteration = result.iterations;
+		}
+		if (fullStep) {
+			damping = damping > 10.0f * min_damping ? 0.1f * damping : 0.0f;
+		}
+	}
+	if (!result.converged && residual > bestResidual) {
+		std::copy(m_best.begin(), m_best.end(), coords.begin());
+		energy = evaluate(origami, true);
+		residual = maxNorm(m_gradient);
+	}
+
+	std::fill(origami.vertices.velocity.begin(), origami.vertices.velocity.end(), glm::vec3(0));
+	origami.m_force_cache_used = false;
+	result.energy = energy;
+	result.residual = float(residual);
+	return result;
+}
+
+StaticSolveResult StaticSolver::solveInStages(Origami& origami, int stages)
+{
+	const float target = origami.target_angle_percent;
+	const size_t n = origami.vertices.size();
+	auto& coords = origami.vertices.coords;
+	StaticSolveResult total;
+	// fractions of the target reached and of the next increment; a stage that fails is tried again in halves,
+	// from the last shape that converged
+	const float increment = 1.0f / float(std::max(stages, 1));
+	float reached = 0.0f;
+	float stage = increment;
+	std::vector<glm::vec3> converged(coords.begin(), coords.begin() + static_cast<std::ptrdiff_t>(n));
+	while (true) {
+		// the last increment goes all the way, whatever rounding the fractions picked up
+		const float next = reached + stage > 1.0f - 1e-4f ? 1.0f : reached + stage;
+		origami.target_angle_percent = target * next;
+		StaticSolveResult result = solve(origami);
+		total.iterations += result.iterations;
+		total.cg_iterations += result.cg_iterations;
+		total.residual = result.residual;
+		total.energy = result.energy;
+		if (result.converged) {
+			reached = next;
+			if (reached >= 1.0f) {
+				total.converged = true;
+				break;
+			}
+			converged.assign(coords.begin(), coords.begin() + static_cast<std::ptrdiff_t>(n));
+			stage = std::min(2.0f * stage, increment);
+		} else if (next - reached > 1.5f * increment / float(1 << std::max(max_subdivisions, 0))) {
+			std::copy(converged.begin(), converged.end(), coords.begin());
+			stage = 0.5f * (next - reached);
+		} else {
+			break;
+		}
+	}
+	origami.target_angle_percent = target;
+	return total;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <glm/vec3.hpp>
+#include <vector>
+#include "conjugate_gradient.h"
+#include "origami.h"
+
+struct StaticSolveResult {
+	bool converged = false;
+	/// <summary>
+	/// Number of Newton iterations and the total number of conjugate gradient iterations over all of them.
+	/// </summary>
+	int iterations = 0;
+	int cg_iterations = 0;
+	/// <summary>
+	/// Largest net constraint force on a vertex at the end of the solve.
+	/// </summary>
+	float residual = 0.0f;
+	/// <summary>
+	/// Total energy of the enabled axial, crease and face constraints at the end of the solve.
+	/// </summary>
+	double energy = 0.0;
+};
+
+/// <summary>
+/// Finds the rest shape of an origami at its current target_angle_percent without simulating the dynamics, by
+/// minimizing the total energy of the axial, crease and face constraints. The forces of Origami are exactly the
+/// negative gradient of that energy, so a minimum is an equilibrium of the simulation as well.
+/// </summary>
+class StaticSolver {
+public:
+	/// <summary>
+	/// Stop once the residual is below this, or after max_iterations Newton iterations. The energy and forces
+	/// are computed in double precision, but the positions are stored as float, which puts a floor of about 1e-4
+	/// under the residual of larger patterns and up to 1e-2 when faces get thin.
+	/// </summary>
+	float tolerance = 1e-3f;
+	int max_iterations = 200;
+	int cg_max_iterations = 200;
+	/// <summary>
+	/// Added to the diagonal of the Hessian, relative to its average diagonal. Needed because the energy does
+	/// not change under rigid motions, so the Hessian alone is singular.
+	/// </summary>
+	float regularization = 1e-6f;
+	/// <summary>
+	/// Largest distance a vertex may move in one Newton iteration. The origami is scaled to a unit box.
+	/// </summary>
+	float max_step_length = 0.05f;
+	/// <summary>
+	/// Levenberg damping added to the Hessian after a failed line search, relative to its average diagonal. It
+	/// starts at min_damping, grows tenfold with every failure and shrinks again after full steps. The solve
+	/// gives up once it exceeds max_damping, where the steps are too short to make any progress.
+	/// </summary>
+	float min_damping = 1e-4f;
+	float max_damping = 1e4f;
+	/// <summary>
+	/// The solve gives up once the residual is this many times above the one it started from.
+	/// </summary>
+	float max_residual_growth = 100.0f;
+	/// <summary>
+	/// The solve also gives up after this many iterations without halving the smallest residual so far.
+	/// </summary>
+	int stall_iterations = 100;
+	/// <summary>
+	/// How many times solveInStages may halve a stage that does not converge.
+	/// </summary>
+	int max_subdivisions = 4;
+
+	/// <summary>
+	/// Moves the vertices of the origami to the equilibrium closest to their current positions and sets all
+	/// velocities to zero. Only reports convergence once the residual is below the tolerance; otherwise the
+	/// vertices are left at the iterate with the smallest residual.
+	/// </summary>
+	StaticSolveResult solve(Origami& origami);
+
+	/// <summary>
+	/// Raises the fold percent from 0 to origami.target_angle_percent in the given number of equal increments
+	/// and solves after each of them. For patterns with many creases that start out flat the fold angles are too
+	/// far from the linear model for a single solve. A stage that does not converge is started again from the
+	/// last converged shape with half the increment, up to max_subdivisions times; after that the whole solve
+	/// counts as failed. The residual and energy are those of the last solve, the iterations of all of them.
+	/// </summary>
+	StaticSolveResult solveInStages(Origami& origami, int stages = 5);
+
+private:
+	/// <summary>
+	/// Energy at the current positions. With gradients set, also fills m_gradient and the constraint
+	/// gradients the Hessian-vector products are made of.
+	/// </summary>
+	double evaluate(Origami& origami, bool gradients);
+
+	/// <summary>
+	/// out = (H + mu I) in, with H the Gauss-Newton approximation of the Hessian: k g g^T summed over all
+	/// constraints. Never stored, it is applied constraint by constraint.
+	/// </summary>
+	void multiplyHessian(const Origami& origami, std::span<const glm::vec3> in, std::span<glm::vec3> out) const;
+
+	std::vector<glm::vec3> m_gradient;
+	std::vector<glm::dvec3> m_gradient_sum;
+	// per constraint gradients at the current Newton iterate
+	std::vector<glm::vec3> m_edge_directions;
+	std::vector<float> m_crease_stiffness;
+	std::vector<glm::vec3> m_crease_gradients;
+	std::vector<glm::vec3> m_face_gradients;
+
+	// block Jacobi preconditioner
+	std::vector<glm::mat3> m_diagonal_inverse;
+	float m_mu = 0.0f;
+
+	std::vector<glm::vec3> m_rhs;
+	std::vector<glm::vec3> m_step;
+	std::vector<glm::vec3> m_start;
+	std::vector<glm::vec3> m_best;
+	ConjugateGradientWorkspace m_cg_workspace;
+};
@@ -0,0 +1,82 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+{
+	for (unsigned int i = 1; i < threads; i++) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_start.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+unsigned int ThreadPool::size() const
+{
+	return static_cast<unsigned int>(m_workers.size()) + 1;
+}
+
+void ThreadPool::run(size_t count, Task task, void* context)
+{
+	if (m_workers.empty() || count < size()) {
+		task(context, 0, 0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_context = context;
+		m_count = count;
+		m_pending = static_cast<unsigned int>(m_workers.size());
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	runChunk(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void ThreadPool::runChunk(unsigned int chunk)
+{
+	size_t begin = m_count * chunk / size();
+	size_t end = m_count * (chunk + 1) / size();
+	if (begin < end) {
+		m_task(m_context, chunk, begin, end);
+	}
+}
+
+void ThreadPool::workerLoop(unsigned int chunk)
+{
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop) {
+				return;
+			}
+			seen = m_generation;
+		}
+
+		runChunk(chunk);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			last = --m_pending == 0;
+		}
+		if (last) {
+			m_done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// <summary>
+/// Fixed set of worker threads for splitting the solver loops. The calling thread takes part in the work,
+/// so a pool of size 1 has no workers and simply runs everything inline.
+/// </summary>
+class ThreadPool {
+public:
+	ThreadPool(unsigned int threads);
+	ThreadPool(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// <summary>
+	/// Number of threads working on a parallelFor, including the calling thread.
+	/// </summary>
+	unsigned int size() const;
+
+	/// <summary>
+	/// Calls body(begin, end) on disjoint ranges that together cover [0, count) and returns once all of them
+	/// are done. The ranges only depend on count and the pool size. Does not allocate.
+	/// </summary>
+	template<typename F>
+	void parallelFor(size_t count, F&& body) {
+		run(count, [](void* context, unsigned int, size_t begin, size_t end) { (*static_cast<std::remove_reference_t<F>*>(context))(begin, end); }, &body);
+	}
+
+	/// <summary>
+	/// parallelFor that calls body(chunk, begin, end), with chunk below size() and different for every range,
+	/// so every range can keep partial results in its own slot.
+	/// </summary>
+	template<typename F>
+	void parallelForChunks(size_t count, F&& body) {
+		run(count, [](void* context, unsigned int chunk, size_t begin, size_t end) { (*static_cast<std::remove_reference_t<F>*>(context))(chunk, begin, end); }, &body);
+	}
+
+private:
+	using Task = void (*)(void*, unsigned int, size_t, size_t);
+
+	void run(size_t count, Task task, void* context);
+	void runChunk(unsigned int chunk);
+	void workerLoop(unsigned int chunk);
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_done;
+	uint64_t m_generation = 0;
+	unsigned int m_pending = 0;
+	bool m_stop = false;
+
+	Task m_task = nullptr;
+	void* m_context = nullptr;
+	size_t m_count = 0;
+};